@@ -11,192 +11,468 @@
   |*| @description: parameterized constructor that takes address of E2 device from the board;
   |*| @PARAM: _port_addr describes the type of wiring and ranges from 0-7, defaluted to 0
   \*/
-LogData::LogData(uint8_t _port_addr) : IIC_ADDR_E2(0xA0 | _port_addr << 1) {}
+LogData::LogData(uint8_t _port_addr) : IIC_ADDR_E2(0xA0 | _port_addr << 1),
+  hpage(-1), seq(0), filled(0), written(0), started(false), latency(LOG_FLUSH_MS), tm(FlushTimer, this) {
+  // the 24LC512 runs at 400 kHz and takes up to 5 ms to write a page, during which the
+  // driver polls it. Get() rather than OS: this may be constructed before the kernel
+  Kernel::IIC::Get().SetSpeed(IIC_ADDR_E2, Kernel::IIC_SPEED_400K);
+  Kernel::IIC::Get().SetWriteCycle(IIC_ADDR_E2, E2_WRITE_MS);
+}
 
 
   /*\ ---------------------------------------------
-  |*| @name: get_addr
-  |*| @description: gets last recently used address
+  |*| @name: rec_addr
+  |*| @description: records never straddle a page, so each is one page write
   \*/
-int LogData::get_addr() {
-  struct dbuff{
-    u_char addr[2];
-    char data[4];
-  } rd;
-  
-  rd.addr[0] = this->L_ADDR >> 8;
-  rd.addr[1] = this->L_ADDR;
+uint16_t LogData::rec_addr(int _rec) {
+  return (_rec / LOG_PER_PAGE) * E2_PAGE + LOG_PAGE_HEADER + (_rec % LOG_PER_PAGE) * LOG_RECORD_SIZE;
+}
 
-  Kernel::OS.IICDriver.IICWrite(IIC_ADDR_E2, rd.addr, 2);
-  Kernel::OS.IICDriver.IICRead(IIC_ADDR_E2, (u_char *)&rd.data, 4);
-  int _ = (rd.data[0] - 48) * 1000;
-  _ += (rd.data[1] - 48) * 100;
-  _ += (rd.data[2] - 48) * 10;
-  _ += rd.data[3] - 48;
 
-  Serial.println(rd.data);
-  return _;
+  /*\ ---------------------------------------------
+  |*| @name: page_header
+  |*| @return: 1 if the page has a valid header, 0 if it is blank or torn, or an IIC error
+  \*/
+int LogData::page_header(int _pg, LOGPAGE* _p) {
+  u_char addr[2];
+  uint8_t hdr[LOG_PAGE_HEADER];
+
+  addr[0] = (_pg * E2_PAGE) >> 8;
+  addr[1] = _pg * E2_PAGE;
+  int _ = Kernel::OS.IICDriver.Transfer(IIC_ADDR_E2, addr, 2, hdr, LOG_PAGE_HEADER);
+  if (_)
+    return _;
+  return LogDecodePage(hdr, _p) ? 1 : 0;
 }
 
 
   /*\ ---------------------------------------------
-  |*| @name: upd_addr 
-  |*| @description: updates last recently used address
-  |*| @STATUS: tested : works
+  |*| @name: find_head
+  |*| @description: pages are written in turn from page 0, so from page 0 up to the head
+  |*| each page's sequence number is page 0's plus its index; past the head, pages are
+  |*| blank (first time round), torn, or one lap older. That splits the ring in two, and
+  |*| the head is found by bisection: 10 header reads for 512 pages, then the head page
+  |*| itself. On a blank E2, the head is set up so that the first record starts page 0.
+  |*| @return: 0, or the IIC error that stopped the search
   \*/
-void LogData::upd_addr(int _caddr) {
-  ++_caddr;
-  
-  if(_caddr >= 2044)
-    _caddr = 0;
-  
-  int _[4];
-  
-  struct upload{
-    u_char addr[2];
-    char dbuff[4];
-  } upd;
+int LogData::find_head() {
+  LOGPAGE first, _p;
+
+  int _ = page_header(0, &first);
+  if (_ < 0)
+    return _;
+  if (!_) {
+    // blank, or page 0 was torn just after the ring wrapped: then the head is the last
+    _ = page_header(LOG_PAGES - 1, &_p);
+    if (_ < 0)
+      return _;
+    if (_)
+      return load_head(LOG_PAGES - 1);
 
-  upd.addr[0] = this->L_ADDR >> 8;
-  upd.addr[1] = this->L_ADDR;
+    hpage = LOG_PAGES - 1;
+    seq = 0;
+    span = 0;
+    filled = written = LOG_PER_PAGE;
+    started = true;
+    return 0;
+  }
 
-  
-  for(auto i = 3; i >= 0 ; --i)
-  {
-    _[i] = _caddr % 10;
-    _caddr = _caddr / 10;
+  int lo = 0, hi = LOG_PAGES; // page lo is up to the head, page hi past it
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    _ = page_header(mid, &_p);
+    if (_ < 0)
+      return _;
+    if (_ && (_p.seq == first.seq + mid))
+      lo = mid;
+    else
+      hi = mid;
   }
+  return load_head(lo);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: load_head
+  |*| @description: loads the head page into the append buffer; its records run from the
+  |*| first slot up to the first that does not decode, so a torn record is overwritten
+  \*/
+int LogData::load_head(int _pg) {
+  u_char addr[2];
+  LOGPAGE _p;
+  LOGRECORD rec;
+
+  addr[0] = (_pg * E2_PAGE) >> 8;
+  addr[1] = _pg * E2_PAGE;
+  int _ = Kernel::OS.IICDriver.Transfer(IIC_ADDR_E2, addr, 2, buf, E2_PAGE);
+  if (_)
+    return _;
+  if (!LogDecodePage(buf, &_p))
+    return 2; // it read differently a moment ago
 
-  for(auto i = 0; i < 4; ++i)
-    upd.dbuff[i] = _[i] + 48;
-  
-  Serial.print("Update Address - final upd value: ");Serial.println(upd.dbuff);
-  Kernel::OS.IICDriver.IICWrite(this->IIC_ADDR_E2, (u_char*)&upd, 6);
+  hpage = _pg;
+  seq = _p.seq;
+  span = _p.span;
+  filled = 0;
+  while ((filled < LOG_PER_PAGE) && LogDecode(&buf[LOG_PAGE_HEADER + filled * LOG_RECORD_SIZE], &rec))
+    ++filled;
+  written = filled;
+  started = true;
+  return 0;
 }
 
 
+  /*\ ---------------------------------------------
+  |*| @name: next_page
+  |*| @description: starts the page after the head in the append buffer, erased but for
+  |*| its header. Nothing reaches the E2 until the first flush, which writes the whole
+  |*| page, so that records from the last time round can't show through.
+  \*/
+void LogData::next_page(bool _reset) {
+  if (started) {
+    hpage = (hpage + 1) % LOG_PAGES;
+    ++seq;
+    if (span < LOG_PAGES)
+      ++span;
+  }
+  if (_reset)
+    span = 1;
+
+  LOGPAGE _p = {seq, span};
+  memset(buf, 0xFF, sizeof(buf));
+  LogEncodePage(&_p, buf);
+  filled = written = 0;
+  started = false;
+}
+
 
   /*\ ---------------------------------------------
   |*| @name: Reset
-  |*| @description: Resets last recently used address to 0
-  |*| @STATUS: tested : works
+  |*| @description: Empties the log. Nothing is erased: a new page with a span of 1 is
+  |*| written, and the pages before it are no longer part of the log. Needs the devlock.
   \*/
-void LogData::Reset(int _dl) {
-  Write(2044, "0000", _dl);
-} 
+int LogData::Reset(int _dl) {
+  if (_dl != DEVLOCK)
+    return 1;
+  if (hpage < 0) {
+    int _ = find_head();
+    if (_)
+      return _;
+  }
+  Flush();
+  next_page(true);
+  return Flush();
+}
 
 
   /*\ ---------------------------------------------
-  |*| @name: Write
-  |*| @description: writes consequently data to EEPROM
-  |*| @NOTE: 
-  \*/
-int LogData::WriteAuto(c_char* _data) {
-  int _a = get_addr();
-  
-  Serial.print("WriteAuto - addr1: "); Serial.println(_a);
-  if(_a >= 2044)
-    _a = 0;
-  
-  Serial.print("WriteAuto - addr2: "); Serial.println(_a);
-  int _ = Write(_a, _data);
-  Serial.print("WriteAuto - writing result: ");Serial.println(_);
-  
-  if(!_)
-    this->upd_addr(_a);
+  |*| @name: Append
+  |*| @description: writes consequently data to EEPROM, through the append buffer. The
+  |*| E2 writes a whole page in the same write cycle as one byte, so records are written
+  |*| a page at a time: when the page fills, when the oldest has waited the flush latency,
+  |*| or on Flush. Each of those is one E2 write, and there is nothing else to update.
+  |*| @return: 0, or the error of a page write
+  \*/
+int LogData::Append(const LOGRECORD& _rec) {
+  if (hpage < 0) {
+    int _ = find_head();
+    if (_)
+      return _;
+  }
+
+  if (filled == LOG_PER_PAGE) {
+    // a full page still buffered after a failed write: it must go before another record
+    int _ = Flush();
+    if (_)
+      return _;
+    next_page(false);
+  }
+
+  LogEncode(&_rec, &buf[LOG_PAGE_HEADER + filled * LOG_RECORD_SIZE]);
+  ++filled;
+
+  if (filled == LOG_PER_PAGE)
+    return Flush();
+  if ((filled - written == 1) && latency)
+    tm.Start(latency);
+  return 0;
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: Flush
+  |*| @description: writes the buffered records as one page write: the whole page the
+  |*| first time, the new records after that. A failed write keeps the records, and is
+  |*| retried after the flush latency.
+  \*/
+int LogData::Flush() {
+  tm.Stop();
+  if ((hpage < 0) || (started && (written == filled)))
+    return 0;
+
+  uint8_t from = started ? LOG_PAGE_HEADER + written * LOG_RECORD_SIZE : 0;
+  uint8_t to = started ? LOG_PAGE_HEADER + filled * LOG_RECORD_SIZE : E2_PAGE;
+  uint16_t _a = hpage * E2_PAGE + from;
+  u_char addr[2];
+
+  addr[0] = _a >> 8;
+  addr[1] = _a;
 
+  Kernel::IICSEGMENT wr[2] = {
+    { addr, 2, IIC_SEG_WRITE },
+    { &buf[from], (uint16_t)(to - from), IIC_SEG_WRITE | IIC_SEG_NOSTART }
+  };
+
+  int _ = Kernel::OS.IICDriver.Transfer(this->IIC_ADDR_E2, wr, 2);
+  if (!_) {
+    started = true;
+    written = filled;
+  } else if (latency) {
+    tm.Start(latency);
+  }
   return _;
 }
 
+void LogData::FlushTimer(void* _ctx) {
+  ((LogData*)_ctx)->Flush();
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: SetFlushLatency
+  |*| @description: longest an appended record may wait in RAM before it is written;
+  |*| takes effect from the next buffered record. 0 leaves records in RAM until their
+  |*| page fills or Flush is called.
+  \*/
+void LogData::SetFlushLatency(unsigned long _ms) {
+  latency = _ms;
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: Head
+  |*| @return: the record slot the next Append will fill, or -1 if the head can't be found
+  \*/
+int LogData::Head() {
+  if ((hpage < 0) && find_head())
+    return -1;
+  if (filled == LOG_PER_PAGE)
+    return ((hpage + 1) % LOG_PAGES) * LOG_PER_PAGE;
+  return hpage * LOG_PER_PAGE + filled;
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: Tail
+  |*| @description: the head page's span says how many pages the log has, so the tail
+  |*| needs no search of its own
+  |*| @return: the first record slot of the oldest page, or -1 if the head can't be found
+  \*/
+int LogData::Tail() {
+  if ((hpage < 0) && find_head())
+    return -1;
+  return ((hpage + LOG_PAGES - span + 1) % LOG_PAGES) * LOG_PER_PAGE;
+}
+
 
   /*\ ---------------------------------------------
   |*| @name: Write
-  |*| @description: writes consequently data to EEPROM
-  |*| @NOTE: 
+  |*| @description: writes one record at its slot, whatever the head
+  |*| @NOTE:
   \*/
-int LogData::Write(int _page, c_char* _data, int _dl) {
-    if(ok(_pg, _dl))
+int LogData::Write(int _rec, const LOGRECORD& _data, int _dl) {
+    if(ok(_rec, _dl))
       return 1;
-    
-  struct dbuff{
-    u_char addr[2];
-    char data[32];
-  } wr;
-  
-  wr.addr[0] = (_page * 32) >> 8; 
-  wr.addr[1] = _page * 32; 
-  strcpy(wr.data, _data);
+    int _f = Flush(); // else the buffer might overwrite it later
+    if(_f)
+      return _f;
+
+  u_char addr[2];
+  uint8_t rec[LOG_RECORD_SIZE];
+  uint16_t _ = rec_addr(_rec);
+
+  addr[0] = _ >> 8;
+  addr[1] = _;
+  LogEncode(&_data, rec);
+  if (_rec / LOG_PER_PAGE == hpage)
+    memcpy(&buf[_ % E2_PAGE], rec, LOG_RECORD_SIZE); // keep the head page in step
+
+  // address and record go out as one bus write, straight from their own buffers
+  Kernel::IICSEGMENT wr[2] = {
+    { addr, 2, IIC_SEG_WRITE },
+    { rec, LOG_RECORD_SIZE, IIC_SEG_WRITE | IIC_SEG_NOSTART }
+  };
+
+  return Kernel::OS.IICDriver.Transfer(this->IIC_ADDR_E2, wr, 2);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: Read
+  |*| @description: reads and decodes one record, from the append buffer if it is there
+  \*/
+int LogData::Read(int _rec, LOGRECORD& _data, int _dl) {
+  if(ok(_rec, _dl))
+    return 1;
+  if ((_rec / LOG_PER_PAGE == hpage) && (_rec % LOG_PER_PAGE < filled))
+    return LogDecode(&buf[rec_addr(_rec) % E2_PAGE], &_data) ? 0 : 2;
+
+  u_char addr[2];
+  uint8_t rec[LOG_RECORD_SIZE];
+  uint16_t _a = rec_addr(_rec);
+
+  addr[0] = _a >> 8;
+  addr[1] = _a;
 
-  return Kernel::OS.IICDriver.IICWrite(this->IIC_ADDR_E2, (u_char*)&wr,  34);
+  int _ = Kernel::OS.IICDriver.Transfer(IIC_ADDR_E2, addr, 2, rec, LOG_RECORD_SIZE);
+  if (_)
+    return _;
+  return LogDecode(rec, &_data) ? 0 : 2;
 }
 
 bool LogData::ok(int _a, int _d){
-  if((_a >= 2044) && (_d != DEVLOCK)){
-    Serial.println("ERROR: Invalid address!\nYou can only enter values between 0 and 2043, unless you have the devlock.");
+  if(((_a < 0) || (_a >= LOG_RECORDS)) && (_d != DEVLOCK)){
+    Serial.print("ERROR: Invalid address!\nYou can only enter values between 0 and ");
+    Serial.print(LOG_RECORDS - 1);
+    Serial.println(", unless you have the devlock.");
     return 1;
   }
-  
+
   if ( _d == DEVLOCK)
     Serial.println("VALID: DEVLOCK");
-  
+
   return 0;
 }
 
   /*\ ---------------------------------------------
-  |*| @name: ReadPage
-  |*| @description: Reads all pages
+  |*| @name: PrintPage
+  |*| @description: stream sink: prints the records of each page that come between from
+  |*| and to; those of pages without a valid header only if any is set
+  \*/
+typedef struct _LOGCURSOR
+{
+  int rec; // first slot of the page
+  int from, to;
+  bool any;
+} LOGCURSOR;
+
+static int PrintPage(void* _ctx, const uint8_t* _buf, uint16_t _len) {
+  LOGCURSOR* _c = (LOGCURSOR*)_ctx;
+  LOGPAGE _p;
+
+  if (_c->any || LogDecodePage(_buf, &_p)) {
+    for (auto i = 0; i < LOG_PER_PAGE; ++i) {
+      LOGRECORD rec;
+      char line[40];
+      if ((_c->rec + i >= _c->from) && (_c->rec + i <= _c->to) &&
+          LogDecode(&_buf[LOG_PAGE_HEADER + i * LOG_RECORD_SIZE], &rec)) {
+        LogFormat(&rec, line, sizeof(line));
+        Serial.print(line); // waits while the serial buffer is full, and the bus with it
+      }
+    }
+  }
+  _c->rec = (_c->rec + LOG_PER_PAGE) % LOG_RECORDS;
+  return _len;
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: stream
+  |*| @description: Prints the records of pages from _pg on, round the ring, as one
+  |*| sequential read: the address is set once, and each page comes into the buffer in
+  |*| turn with the bus held while it prints. The E2's address rolls over from the end
+  |*| to 0, as the ring does.
+  \*/
+int LogData::stream(int _pg, int _npages, int _from, int _to, bool _any) {
+  LOGCURSOR _c = {_pg * LOG_PER_PAGE, _from, _to, _any};
+  u_char addr[2];
+  uint8_t page[E2_PAGE];
+
+  addr[0] = (_pg * E2_PAGE) >> 8;
+  addr[1] = _pg * E2_PAGE;
+
+  return Kernel::OS.IICDriver.Stream(IIC_ADDR_E2, addr, 2, page, E2_PAGE,
+                                     (unsigned long)_npages * E2_PAGE, PrintPage, &_c);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: ReadAll
+  |*| @description: Prints all records, oldest first: round the ring from the tail to
+  |*| the head, in one read
+  |*| @Note: blocks until the last record is in the serial buffer, paced by the port: a
+  |*| full log is about 180 KB of text, 16 s at 115200 baud, during which no task runs
   \*/
 int LogData::ReadAll() {
-  int _ = 0;
-  for (auto i = 0; i < 2044; ++i)
-    _ = ReadPage(i);
-  return _;
+  int tail = Tail();
+  if (tail < 0)
+    return 1;
+  Flush(); // buffered records print too
+  if (!span)
+    return 0;
+
+  return stream(tail / LOG_PER_PAGE, span, 0, LOG_RECORDS - 1, false);
 }
 
 
   /*\ ---------------------------------------------
   |*| @name: ReadPage
-  |*| @description: Reads 32B page from addr
-  |*| @TODO: add _format function to println for values that dont have '\n' at the end. 
-  |*| : Maybe format like CSV?
+  |*| @description: Prints the records of the 128B page, read at once. A page without a
+  |*| valid header is not part of the log and prints nothing.
   \*/
 int LogData::ReadPage(int _pg, int _dl) {
 
-  if(ok(_pg, _dl))
+  if(ok(_pg * LOG_PER_PAGE, _dl))
     return 1;
-  
-  struct dbuff{
-    u_char addr[2];
-    char data[32];
-  } rd;
-  
-  rd.addr[0] = (_pg * 32) >> 8;
-  rd.addr[1] = _pg * 32;
-
-  Kernel::OS.IICDriver.IICWrite(IIC_ADDR_E2, rd.addr, 2);
-  int _ = Kernel::OS.IICDriver.IICRead(IIC_ADDR_E2, (u_char *)&rd.data, 32);
-  Serial.print(rd.data);
-  return _;
+  Flush(); // buffered records print too
+
+  return stream(_pg, 1, 0, LOG_RECORDS - 1, false);
 }
 
 
   /*\ ---------------------------------------------
   |*| @name: ReadFT
-  |*| @description: Reads from - to
+  |*| @description: Prints records from - to, whatever their pages, in one read of the
+  |*| pages that hold them
   \*/
-int LogData::ReadFT(int _saddr, int _eaddr, int _dl) {
-  if ((_eaddr * 32) > E2_END_ADDR)
-   return 1;
-  if ((_saddr * 32) > E2_END_ADDR)
-   return 1;
-  if (_saddr > _eaddr)
+int LogData::ReadFT(int _srec, int _erec, int _dl) {
+  if (_srec > _erec)
    return 1;
-  if ((_saddr * 32) > E2_END_ADDR - 32)
-   return 1;
-  
-  int _ = 1;
-  for (auto i = _saddr; i <= _eaddr; ++i)
-    _ = ReadPage(i);
-    
-  return _;
+  if (ok(_srec, _dl) || ok(_erec, _dl))
+    return 1;
+  Flush(); // buffered records print too
+
+  int _pg = _srec / LOG_PER_PAGE;
+  return stream(_pg, _erec / LOG_PER_PAGE - _pg + 1, _srec, _erec, true);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: SerialSink
+  |*| @description: stream sink: takes what the serial buffer has room for, and nothing
+  |*| while it is full, so the bus is held while the port catches up
+  \*/
+static int SerialSink(void*, const uint8_t* _buf, uint16_t _len) {
+  int _ = Serial.availableForWrite();
+  if (_ > _len)
+    _ = _len;
+  return Serial.write(_buf, _);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: Export
+  |*| @description: Sends the whole 64 KB E2, as logdecode reads it, in one sequential
+  |*| read from address 0. The bus runs as fast as the serial port takes the data.
+  |*| @Note: blocks for the whole transfer, 5.7 s at 115200 baud, during which no task
+  |*| runs and the E2 read is held between chunks
+  \*/
+int LogData::Export() {
+  Flush(); // buffered records go too
+
+  u_char addr[2] = {0, 0};
+  uint8_t chunk[SERIAL_TX_BUFFER_SIZE];
+
+  return Kernel::OS.IICDriver.Stream(IIC_ADDR_E2, addr, 2, chunk, sizeof(chunk),
+                                     E2_END_ADDR + 1UL, SerialSink, NULL);
 }
@@ -4,40 +4,66 @@
 |*| @date: 18/10/2022
 |*| @description: Derived from Task - this uses a non-volatile E2 data logger to 
 |*| maintain a recording of events that have taken place
-|*| @Note: max size: 512 pages (655536B | 128B/page), I want each writeto be 32B long (2044 entries + 4 reserved for meta data) 0-2044
-|*| @Note: data entry exapmle: "dd/mm/yy,hh:mm:ss,tt,aaa,ddd\n"
+|*| @Note: max size: 512 pages (65536B | 128B/page). Each page holds a sequence-numbered
+|*| header and 12 packed 10B records (6144 records, see LogRecord.h), written as a ring.
+|*| @Note: records print as: "dd/mm/yy,hh:mm:ss,type,value0,value1\n"
 \*/ 
 
 #ifndef LOGDATA_H_
 #define LOGDATA_H_
 
 #include "kernel.h"
+#include "LogRecord.h"
 
 #define E2_END_ADDR 0xFFFF
 #define DEVLOCK 312
+#define E2_WRITE_MS 5 // longest page write cycle
+#ifndef LOG_FLUSH_MS
+#define LOG_FLUSH_MS 1000 // longest an appended record waits in RAM; 0 to wait for a full page
+#endif
 
 typedef const char c_char;
 typedef unsigned char u_char;
 
 class LogData { 
   uint8_t IIC_ADDR_E2; //device address
-  const uint16_t L_ADDR = 0xFF80; //2044 // 65408
   bool ok(int _a, int _d);
+  uint16_t rec_addr(int _rec); // E2 address of a record
+
+  int page_header(int _pg, LOGPAGE* _p); // 1 if a log page, 0 if not, or an IIC error
+  int find_head(); // find the head page and load it
+  int load_head(int _pg); // load the head page
+  void next_page(bool _reset); // start the page after the head
+  int stream(int _pg, int _npages, int _from, int _to, bool _any); // print pages in one E2 read
 
-  //disabeled
-  int WriteAuto(c_char* _data); 
-  int get_addr(); // get last recently used address
-  void upd_addr(int _caddr); // update last recently used address
-  void Reset(int _dl = 0);
+  // append buffer: the head page as it will be in the E2
+  uint8_t buf[E2_PAGE];
+  int hpage; // head page, -1 until found
+  uint32_t seq; // its sequence number
+  uint16_t span; // and pages in the log up to it
+  uint8_t filled; // record slots used
+  uint8_t written; // of which in the E2
+  bool started; // header in the E2
+  unsigned long latency; // ms
+  Kernel::Timer tm; // flushes after latency
+  static void FlushTimer(void* _ctx);
 	
 	public:
 	LogData(uint8_t _port_addr = 0); //init slave eeprom's address //doesnt have unique value check (may crush on the bus);
   ~LogData(){};
   
-  int Write(int _page, c_char* _data, int _dl = 0); //_dl is devlock for unlimited access to the eeprom
-  int ReadAll(); // reads all pages at once;
-  int ReadPage(int _pg, int _dl = 0); // reads specific page
-  int ReadFT(int _saddr, int _eaddr, int _dl = 0); // Reads from-to pages
+  int Append(const LOGRECORD& _rec); // buffers at the head and advances it
+  int Flush(); // writes the buffered records, one page write
+  int Head(); // next record slot to be appended
+  int Tail(); // oldest record slot; the log is empty if it is the head
+  void SetFlushLatency(unsigned long _ms); // 0 to flush only full pages
+  int Write(int _rec, const LOGRECORD& _data, int _dl = 0); //_dl is devlock for unlimited access to the eeprom
+  int Read(int _rec, LOGRECORD& _data, int _dl = 0); // 0 ok, 1 bad index, 2 empty or corrupt, or an IIC error
+  int ReadAll(); // prints all records, oldest first; blocks while the serial port sends them
+  int ReadPage(int _pg, int _dl = 0); // prints the records of one E2 page
+  int ReadFT(int _srec, int _erec, int _dl = 0); // prints records from-to
+  int Export(); // sends the whole E2, raw, to the serial port; blocks for the whole transfer
+  int Reset(int _dl = 0); // empties the log, by starting a page that discards the older; needs the devlock
 };
 
 #endif
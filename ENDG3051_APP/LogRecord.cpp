@@ -0,0 +1,125 @@
+  /*\ ---------------------------------------------
+  |*| @name: LogRecord.CPP
+  |*| @INFO: FOR CONTEXT CHECK OUT INCLUDE FILES
+  \*/
+#include <stdio.h>
+#include "LogRecord.h"
+
+static const uint8_t monthdays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+
+  /*\ ---------------------------------------------
+  |*| @name: check
+  |*| @description: check byte over the other bytes; an erased (all 0xFF) or zeroed
+  |*| entry never passes
+  \*/
+static uint8_t check(const uint8_t* _buf, int _len) {
+  uint8_t _ = 0;
+  for (auto i = 0; i < _len; ++i)
+    _ += _buf[i];
+  return ~_;
+}
+
+static void put16(uint8_t* _buf, uint16_t _v) {
+  _buf[0] = _v;
+  _buf[1] = _v >> 8;
+}
+
+static uint16_t get16(const uint8_t* _buf) {
+  return _buf[0] | (_buf[1] << 8);
+}
+
+
+void LogEncode(const LOGRECORD* _rec, uint8_t* _buf) {
+  put16(&_buf[0], _rec->time);
+  put16(&_buf[2], _rec->time >> 16);
+  _buf[4] = _rec->type;
+  for (auto i = 0; i < LOG_VALUES; ++i)
+    put16(&_buf[5 + 2 * i], _rec->value[i]);
+  _buf[LOG_RECORD_SIZE - 1] = check(_buf, LOG_RECORD_SIZE - 1);
+}
+
+bool LogDecode(const uint8_t* _buf, LOGRECORD* _rec) {
+  if ((_buf[4] == LOG_TYPE_ERASED) || (_buf[LOG_RECORD_SIZE - 1] != check(_buf, LOG_RECORD_SIZE - 1)))
+    return false;
+
+  _rec->time = get16(&_buf[0]) | ((uint32_t)get16(&_buf[2]) << 16);
+  _rec->type = _buf[4];
+  for (auto i = 0; i < LOG_VALUES; ++i)
+    _rec->value[i] = get16(&_buf[5 + 2 * i]);
+  return true;
+}
+
+
+void LogEncodePage(const LOGPAGE* _pg, uint8_t* _buf) {
+  put16(&_buf[0], _pg->seq);
+  put16(&_buf[2], _pg->seq >> 16);
+  _buf[4] = LOG_VERSION;
+  put16(&_buf[5], _pg->span);
+  _buf[LOG_PAGE_HEADER - 1] = check(_buf, LOG_PAGE_HEADER - 1);
+}
+
+bool LogDecodePage(const uint8_t* _buf, LOGPAGE* _pg) {
+  if ((_buf[4] != LOG_VERSION) || (_buf[LOG_PAGE_HEADER - 1] != check(_buf, LOG_PAGE_HEADER - 1)))
+    return false;
+
+  _pg->seq = get16(&_buf[0]) | ((uint32_t)get16(&_buf[2]) << 16);
+  _pg->span = get16(&_buf[5]);
+  return (_pg->span >= 1) && (_pg->span <= LOG_PAGES);
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: LogTime
+  |*| @description: 2000 is a leap year, and so is every 4th year up to 2099
+  \*/
+uint32_t LogTime(int year, int month, int day, int hrs, int mins, int secs) {
+  uint32_t days = year * 365UL + (year + 3) / 4;
+
+  for (auto i = 1; i < month; ++i)
+    days += monthdays[i - 1];
+  if ((month > 2) && !(year % 4))
+    ++days;
+  days += day - 1;
+
+  return ((days * 24 + hrs) * 60 + mins) * 60 + secs;
+}
+
+
+  /*\ ---------------------------------------------
+  |*| @name: LogFormat
+  |*| @description: values print as signed fixed point with two decimals; no %f on AVR
+  \*/
+int LogFormat(const LOGRECORD* _rec, char* _buf, size_t _size) {
+  uint32_t days = _rec->time / 86400UL;
+  uint32_t secs = _rec->time % 86400UL;
+  int year = 0, month = 1;
+
+  for (;;) {
+    int _ = (year % 4) ? 365 : 366;
+    if (days < (uint32_t)_)
+      break;
+    days -= _;
+    ++year;
+  }
+  for (;;) {
+    int _ = monthdays[month - 1] + (((month == 2) && !(year % 4)) ? 1 : 0);
+    if (days < (uint32_t)_)
+      break;
+    days -= _;
+    ++month;
+  }
+
+  char values[LOG_VALUES][10];
+  for (auto i = 0; i < LOG_VALUES; ++i) {
+    int32_t _ = _rec->value[i];
+    uint32_t mag = (_ < 0) ? -_ : _;
+    snprintf(values[i], sizeof(values[i]), "%s%u.%02u", (_ < 0) ? "-" : "",
+             (unsigned)(mag >> 8), (unsigned)(((mag & 0xff) * 100) >> 8));
+  }
+
+  return snprintf(_buf, _size, "%02d/%02d/%02d,%02u:%02u:%02u,%u,%s,%s\n",
+                  (int)days + 1, month, year % 100,
+                  (unsigned)(secs / 3600), (unsigned)((secs / 60) % 60), (unsigned)(secs % 60),
+                  _rec->type, values[0], values[1]);
+}
@@ -0,0 +1,82 @@
+/*\ ---------------------------------------------
+|*| @name: LogRecord.H
+|*| @date: 17/10/2026
+|*| @description: Packed binary log record and page header, as stored in the E2 by
+|*| LogData. Plain C++ with no Arduino dependencies, so that the host-side decoder
+|*| can share it.
+|*| @Note: all multi-byte fields are little-endian, whatever the CPU
+|*| @Note: record (10B): time[4] type[1] value0[2] value1[2] check[1]
+|*| @Note: page (128B): header (8B): seq[4] version[1] span[2] check[1], then 12 record
+|*| slots. Pages are written in turn round the whole chip from page 0, each new one with
+|*| the next sequence number, so the log finds its own head and no location is rewritten
+|*| more often than any other. The span says how far back the log starts.
+\*/
+
+#ifndef LOGRECORD_H_
+#define LOGRECORD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_VERSION 3
+#define LOG_RECORD_SIZE 10
+#define LOG_PAGE_HEADER 8
+#define LOG_VALUES 2 // fixed-point sensor fields per record
+
+// layout in the 24LC512: records never straddle a page
+
+#define E2_PAGE 128
+#define LOG_PAGES 512
+#define LOG_PER_PAGE ((E2_PAGE - LOG_PAGE_HEADER) / LOG_RECORD_SIZE)
+#define LOG_RECORDS (LOG_PAGES * LOG_PER_PAGE)
+
+#define LOG_TYPE_ERASED 0xFF // reserved: never a valid event type
+
+#define LOG_FIXED(x) ((int16_t)((x) * 256)) // to Q8.8 fixed point
+
+typedef struct _LOGRECORD
+{
+  uint32_t time;              // seconds since 01/01/2000 00:00:00
+  uint8_t type;               // event type, application defined
+  int16_t value[LOG_VALUES];  // Q8.8
+} LOGRECORD;
+
+typedef struct _LOGPAGE
+{
+  uint32_t seq;               // one more than the page written before it
+  uint16_t span;              // pages in the log up to this one: 1 if it starts it (a reset)
+} LOGPAGE;
+
+/*\ ---------------------------------------------
+|*| @name: LogEncode / LogDecode
+|*| @description: convert a record to and from its stored form
+|*| @return: LogDecode: true if the bytes hold a valid record, false if they are erased
+|*| or corrupt (e.g. a torn write)
+\*/
+void LogEncode(const LOGRECORD* _rec, uint8_t* _buf);
+bool LogDecode(const uint8_t* _buf, LOGRECORD* _rec);
+
+/*\ ---------------------------------------------
+|*| @name: LogEncodePage / LogDecodePage
+|*| @description: convert a page header to and from its stored form
+|*| @return: LogDecodePage: true if the bytes hold a valid header of this version; a
+|*| page without one is blank, or not (yet) part of the log
+\*/
+void LogEncodePage(const LOGPAGE* _pg, uint8_t* _buf);
+bool LogDecodePage(const uint8_t* _buf, LOGPAGE* _pg);
+
+/*\ ---------------------------------------------
+|*| @name: LogTime
+|*| @description: date and time to a record time stamp. Years are 0-99 from 2000, as
+|*| kept by the RTC.
+\*/
+uint32_t LogTime(int year, int month, int day, int hrs, int mins, int secs);
+
+/*\ ---------------------------------------------
+|*| @name: LogFormat
+|*| @description: a record as a line of text: "dd/mm/yy,hh:mm:ss,type,value0,value1\n"
+|*| @return: length of the line, as snprintf
+\*/
+int LogFormat(const LOGRECORD* _rec, char* _buf, size_t _size);
+
+#endif
@@ -23,11 +23,19 @@ typedef RTCDATEREGS *PRTCDATEREGS;
 |*| Maybe we will need to change the timeout dynamically?
 |*| Actually we may use a different mechanism to trigger a log.
 \*/
-LogTask::LogTask(int _timestamp) : tm(_timestamp)
+LogTask::LogTask(int _timestamp) : tm(_timestamp), rtc(IIC_ADDR_RTC)
 {
-  // Now initialize the RTC device and start it running
-  unsigned char iicregs[2] = {0x00, 0x00};
-  Kernel::OS.IICDriver.IICWrite(IIC_ADDR_RTC, iicregs, 2); // write the address.
+  // The time registers, the alarm interrupt flags (in ALMxWKDAY) and the
+  // power-fail time stamps are changed by the RTC itself, so are never cached.
+  // Control, trim and alarm registers are read from the device once.
+  rtc.SetVolatile(0x00, sizeof(RTCDATEREGS));
+  rtc.SetVolatile(0x0d, 1);
+  rtc.SetVolatile(0x14, 1);
+  rtc.SetVolatile(0x18, 8);
+
+  // Now initialize the RTC device and start it running. It runs at 400 kHz.
+  Kernel::IIC::Get().SetSpeed(IIC_ADDR_RTC, Kernel::IIC_SPEED_400K);
+  rtc.Write(0x00, 0x00);
 }
 
 /*\ ---------------------------------------------
@@ -42,11 +50,7 @@ LogTask::LogTask(int _timestamp) : tm(_timestamp)
 
 int LogTask::SetDate(int dow, int day, int month, int year, int hrs, int mins, int secs, bool is24hr, bool ampm)
 {
-  struct _iicdrwrite
-  {
-    uint8_t address;
-    RTCDATEREGS regs;
-  } date;
+  RTCDATEREGS regs;
 
   // we must first error-check our input.
   const int maxmonthdays[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
@@ -77,23 +81,23 @@ int LogTask::SetDate(int dow, int day, int month, int year, int hrs, int mins, i
     if (secs < 0 || secs > 59)
       break;
 
-    date.address = 0;
-    date.regs.sec = bitshift_bcd(secs) | 0x80; // check
-    date.regs.min = bitshift_bcd(mins) | 0x80; // check
+    regs.sec = bitshift_bcd(secs) | 0x80; // check
+    regs.min = bitshift_bcd(mins) | 0x80; // check
 
     if (is24hr)
-      date.regs.hour = bitshift_bcd(hrs); // 24 format check
+      regs.hour = bitshift_bcd(hrs); // 24 format check
     else if (ampm)
-      date.regs.hour = bitshift_bcd(hrs) | 0x40; // 12 format am check
+      regs.hour = bitshift_bcd(hrs) | 0x40; // 12 format am check
     else
-      date.regs.hour = bitshift_bcd(hrs) | 0x60; // 12 format pm check
+      regs.hour = bitshift_bcd(hrs) | 0x60; // 12 format pm check
 
-    date.regs.wkday = (dow) | 0x20;        // check
-    date.regs.date = bitshift_bcd(day);    // check
-    date.regs.month = bitshift_bcd(month); // add leap year thing
-    date.regs.year = bitshift_bcd(year);   // check
+    regs.wkday = (dow) | 0x20;        // check
+    regs.date = bitshift_bcd(day);    // check
+    regs.month = bitshift_bcd(month); // add leap year thing
+    regs.year = bitshift_bcd(year);   // check
 
-    return Kernel::OS.IICDriver.IICWrite(IIC_ADDR_RTC, (unsigned char *)&date, sizeof(struct _iicdrwrite)); // write the address.;
+    // register address and values go out as one bus write
+    return rtc.Write(0x00, &regs, sizeof(RTCDATEREGS));
   
   } while (0);
 
@@ -118,6 +122,7 @@ void LogTask::TaskLoop()
 
     tm.Restart();
   }
+  WakeAfter(tm.Remaining()); // nothing to do until the timer expires
 }
 
 /*\ ---------------------------------------------
@@ -136,10 +141,7 @@ void LogTask::LogToSerial(char *message)
   char logstring[200];
   int seconds, minutes, hours, day, month, year;
   char *amIndicator, weekday;
-  uint8_t iicregs[2] = {0, 0};
-
-  Kernel::OS.IICDriver.IICWrite(IIC_ADDR_RTC, iicregs, 1);                                 // write the address.
-  Kernel::OS.IICDriver.IICRead(IIC_ADDR_RTC, (unsigned char *)&date, sizeof(RTCDATEREGS)); // read the values
+  rtc.Read(0x00, &date, sizeof(RTCDATEREGS)); // volatile, so always from the bus
 
   // now massage to convert from BCD to decimal and write to a string
   bool is12hr = (date.hour & 0b01000000);
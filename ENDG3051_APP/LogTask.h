@@ -11,14 +11,17 @@
 #define LOGTASK_H_
 
 #include "kernel.h"
+#include "iicregs.h"
 
 #define IIC_ADDR_RTC 0xDE
+#define RTC_REGS 0x20 // clock, control and alarm registers; the SRAM is not cached
 #define bitshift_bcd(n) ((n % 10) | ((n / 10) << 4))
 #define bitshift_dec(n,m) (n & 0x0f) + (10 * ((n >> 4) & m))
 
 class LogTask : public Kernel::Task
 {
 	Kernel::OSTimer tm;
+	Kernel::IICRegisterCache<RTC_REGS> rtc;
 
 	void LogToSerial(char *message);
 
@@ -26,6 +26,7 @@ void ToggleTask::TaskLoop()
 		toggleflag=(toggleflag)?false:true;
 		tm.Restart();
 	}
+	WakeAfter(tm.Remaining());		// nothing to do until the timer expires
 }
 
 /*\ ---------------------------------------------
@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+/// BENCH.CPP
+///
+/// Kernel primitive microbenchmarks. Built in place of the application: the
+/// kernel calls UserInit() from setup(), which runs every benchmark and ends
+/// the run.
+///
+/// Figures that cannot be timed in isolation (the private MQClass::Loop and
+/// TaskRing::Loop are only reachable through the kernel's loop()) are
+/// reported as differences against an idle loop() pass.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "kernel.h"
+#include "benchmark.h"
+
+#define BENCH_ITERATIONS	64
+#define BENCH_TASKS			4
+#define BENCH_MSGID			1
+#define BENCH_MSGID_HIGH	2
+#define BENCH_IIC_ADDR		0xA0		// the runner acknowledges everything here
+#define BENCH_IIC_LONG		33
+
+using namespace Kernel;
+
+static volatile unsigned int handled;
+
+static void BenchHandler(void *)
+{
+	handled++;
+}
+
+class BenchTask : public Task {
+	public:
+		virtual void TaskLoop(void) {};
+};
+
+static BenchTask tasks[BENCH_TASKS];
+
+static const BENCHDERIVED derived[] = {
+	{ "mq_loop_dispatch", "loop_one_message", "loop_idle", 1 },
+	{ "taskring_loop_iteration", "loop_tasks", "loop_idle", BENCH_TASKS },
+	{ "iic_write_byte", "iic_write_33", "iic_write_1", BENCH_IIC_LONG-1 },
+};
+
+static void BenchOverhead(void)
+{
+	BenchBegin(BENCH_OVERHEAD);
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		BENCH_START();
+		BENCH_STOP();
+	}
+}
+
+static void BenchPost(const char * name, MQCONTEXT ctx)
+{
+	BenchBegin(name);
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		if(ctx==MQ_CONTEXT_INTERRUPT) {
+			noInterrupts();		// as it would be in an ISR
+		}
+		BENCH_START();
+		OS.MessageQueue.Post(BENCH_MSGID,NULL,MQ_OWNER_CALLER,ctx);
+		BENCH_STOP();
+		interrupts();
+		loop();					// drain, untimed
+	}
+}
+
+static void BenchPostTyped(const char * name, MQCONTEXT ctx)
+{
+	uint32_t sample=0x12345678UL;
+
+	BenchBegin(name);
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		if(ctx==MQ_CONTEXT_INTERRUPT) {
+			noInterrupts();
+		}
+		BENCH_START();
+		OS.MessageQueue.Post(BENCH_MSGID,sample,ctx);
+		BENCH_STOP();
+		interrupts();
+		loop();
+	}
+}
+
+static void BenchLoop(const char * name, bool withMessage)
+{
+	BenchBegin(name);
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		if(withMessage) {
+			OS.MessageQueue.Post(BENCH_MSGID,NULL,MQ_OWNER_CALLER,MQ_CONTEXT_TASK);
+		}
+		BENCH_START();
+		loop();
+		BENCH_STOP();
+	}
+}
+
+// One loop() pass with the normal queue full and a high priority message
+// behind it: the pass must deliver the high priority message regardless.
+
+static void BenchLoopHighBacklog(void)
+{
+	BenchBegin("loop_high_backlog");
+	for(int idx=0;idx<BENCH_ITERATIONS/4;idx++) {
+		while(OS.MessageQueue.Post(BENCH_MSGID,NULL,MQ_OWNER_CALLER,MQ_CONTEXT_TASK)==0);
+		OS.MessageQueue.Post(BENCH_MSGID_HIGH,NULL,MQ_OWNER_CALLER,MQ_CONTEXT_TASK,MQ_PRIORITY_HIGH);
+		BENCH_START();
+		loop();
+		BENCH_STOP();
+		for(int pass=0;pass<MSG_QUEUE_DEPTH;pass++) {
+			loop();				// drain, untimed
+		}
+	}
+}
+
+static void BenchTimer(void)
+{
+	OSTimer tm(1000);
+	volatile int expired=0;
+
+	BenchBegin("ostimer_isexpired");
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		BENCH_START();
+		expired+=tm.isExpired();
+		BENCH_STOP();
+	}
+}
+
+static void BenchWheelTimer(void)
+{
+	Timer tm(BENCH_MSGID);
+
+	BenchBegin("timer_start_stop");
+	for(int idx=0;idx<BENCH_ITERATIONS;idx++) {
+		BENCH_START();
+		tm.Start(1000);
+		tm.Stop();
+		BENCH_STOP();
+	}
+}
+
+static void BenchIIC(const char * name, unsigned int nBytes)
+{
+	static unsigned char buf[BENCH_IIC_LONG];
+
+	BenchBegin(name);
+	for(int idx=0;idx<BENCH_ITERATIONS/4;idx++) {
+		BENCH_START();
+		OS.IICDriver.IICWrite(BENCH_IIC_ADDR,buf,nBytes);
+		BENCH_STOP();
+	}
+}
+
+// a register read: 2-byte address written, 4 bytes read after a repeated START
+
+static void BenchIICTransfer(void)
+{
+	static unsigned char addr[2], buf[4];
+
+	BenchBegin("iic_transfer_2_4");
+	for(int idx=0;idx<BENCH_ITERATIONS/4;idx++) {
+		BENCH_START();
+		OS.IICDriver.Transfer(BENCH_IIC_ADDR,addr,sizeof(addr),buf,sizeof(buf));
+		BENCH_STOP();
+	}
+}
+
+// the same register read four times, batched back to back
+
+static void BenchIICBatch(void)
+{
+	static unsigned char addr[2], buf[4];
+	static IICSEGMENT segs[2]={ { addr, sizeof(addr), IIC_SEG_WRITE }, { buf, sizeof(buf), IIC_SEG_READ } };
+	static IICTransaction trans[4];
+
+	for(int idx=0;idx<4;idx++) {
+		trans[idx].addr=BENCH_IIC_ADDR;
+		trans[idx].segs=segs;
+		trans[idx].nsegs=2;
+	}
+	BenchBegin("iic_batch_4x2_4");
+	for(int idx=0;idx<BENCH_ITERATIONS/4;idx++) {
+		BENCH_START();
+		OS.IICDriver.Batch(trans,4,NULL);
+		BENCH_STOP();
+	}
+}
+
+void UserInit(void)
+{
+	BenchInit();
+	BenchOverhead();
+
+	// the timer tick that wakes an idle kernel is off while measuring
+
+	OS.SetIdleSleep(false);
+
+	OS.MessageQueue.Subscribe(BENCH_MSGID,BenchHandler);
+	OS.MessageQueue.Subscribe(BENCH_MSGID_HIGH,BenchHandler);
+
+	BenchPost("mq_post_task",MQ_CONTEXT_TASK);
+	BenchPost("mq_post_interrupt",MQ_CONTEXT_INTERRUPT);
+	BenchPostTyped("mq_post_typed_task",MQ_CONTEXT_TASK);
+	BenchPostTyped("mq_post_typed_interrupt",MQ_CONTEXT_INTERRUPT);
+
+	// no tasks registered yet: loop() is queue polling only
+
+	BenchLoop("loop_idle",false);
+	BenchLoop("loop_one_message",true);
+	BenchLoopHighBacklog();
+
+	for(int idx=0;idx<BENCH_TASKS;idx++) {
+		tasks[idx].Start();
+	}
+	BenchLoop("loop_tasks",false);
+
+	BenchTimer();
+	BenchWheelTimer();
+
+	BenchIIC("iic_write_1",1);
+	BenchIIC("iic_write_33",BENCH_IIC_LONG);
+	BenchIICTransfer();
+	BenchIICBatch();
+
+	for(unsigned int idx=0;idx<sizeof(derived)/sizeof(derived[0]);idx++) {
+		BenchDerive(&derived[idx]);
+	}
+	BenchDone();
+}
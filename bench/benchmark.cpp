@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+/// BENCHMARK.CPP
+///
+/// Firmware side of the kernel benchmark suite: marker commands
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include "benchmark.h"
+
+#if defined(__AVR__)
+
+#include <avr/sleep.h>
+
+static void BenchCommand(uint8_t cmd, const void * arg)
+{
+	GPIOR1=(uint8_t)((uint16_t)arg);
+	GPIOR2=(uint8_t)((uint16_t)arg>>8);
+	GPIOR0=cmd;
+}
+
+void BenchInit(void)
+{
+	// Timer0 keeps running: the runner leaves its ISR out of the figures
+}
+
+void BenchBegin(const char * name)
+{
+	BenchCommand(BENCH_CMD_BEGIN,name);
+}
+
+void BenchDerive(const BENCHDERIVED * derived)
+{
+	BenchCommand(BENCH_CMD_DERIVE,derived);
+}
+
+void BenchDone(void)
+{
+	BenchCommand(BENCH_CMD_DONE,NULL);
+
+	// sleeping with interrupts off ends the simulation
+
+	cli();
+	sleep_enable();
+	for(;;) {
+		sleep_cpu();
+	}
+}
+
+#else
+
+#include <time.h>
+#include "report.h"
+#include "sim.h"
+
+static BenchReport report;
+
+// the runner puts an always-acknowledging slave at 0xA0 for the IIC
+// benchmarks; do the same on the simulated bus. The figures are the driver's
+// CPU cost, so the bus is run without timing.
+
+static Sim::IICDevice benchSlave(0xA0);
+
+static uint64_t BenchNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+void BenchInit(void)
+{
+	Sim::IICAttach(&benchSlave);
+	Sim::IICTiming(false);
+}
+
+void BenchHostMark(uint8_t cmd)
+{
+	if(cmd==BENCH_CMD_START) {
+		report.Start(BenchNs());
+	} else {
+		report.Stop(BenchNs());
+	}
+}
+
+void BenchBegin(const char * name)
+{
+	report.Begin(name);
+}
+
+void BenchDerive(const BENCHDERIVED * derived)
+{
+	report.Derive(derived->name,derived->minuend,derived->subtrahend,derived->divisor);
+}
+
+void BenchDone(void)
+{
+	const char * path=getenv("BENCH_REPORT");
+	FILE * fp=(path)?fopen(path,"w"):stdout;
+
+	if(fp) {
+		report.Write(fp,"host","ns",0);
+		if(fp!=stdout) {
+			fclose(fp);
+		}
+	}
+	exit((fp)?0:1);
+}
+
+#endif
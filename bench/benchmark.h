@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+/// BENCHMARK.H
+///
+/// Firmware side of the kernel benchmark suite
+///
+/// Benchmarks are bracketed by BENCH_START()/BENCH_STOP() markers. On the
+/// target the markers are single OUT instructions to GPIOR0, which the simavr
+/// runner (simbench.cpp) traps to read the exact cycle counter, so nothing in
+/// the firmware itself is spent on timing. On the host build the markers read
+/// a nanosecond clock instead.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <stdint.h>
+
+// GPIOR0 commands understood by the runner
+
+#define BENCH_CMD_START		1		// start a measurement
+#define BENCH_CMD_STOP		2		// end a measurement
+#define BENCH_CMD_BEGIN		3		// new benchmark, name pointer in GPIOR2:GPIOR1
+#define BENCH_CMD_DERIVE	4		// derived figure, BENCHDERIVED pointer in GPIOR2:GPIOR1
+#define BENCH_CMD_DONE		5		// all done, write the report
+
+// The overhead of an empty START/STOP pair is measured under this name and
+// subtracted from every other measurement
+
+#define BENCH_OVERHEAD		"__overhead"
+
+///////////////////////////////////////////////////////////////////////////////
+/// BENCHDERIVED
+///
+/// A figure computed from two benchmarks when the report is written:
+/// (mean(minuend) - mean(subtrahend)) / divisor. Used where a primitive can
+/// only be timed together with something else, e.g. one message dispatch is
+/// a loop() pass with a message queued less an idle loop() pass.
+///
+/// The layout is read directly from target SRAM by the runner: keep it to
+/// 16-bit pointers and integers.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct _BENCHDERIVED {
+	const char *	name;
+	const char *	minuend;
+	const char *	subtrahend;
+	uint16_t		divisor;
+} BENCHDERIVED;
+
+#if defined(__AVR__)
+
+#include <avr/io.h>
+
+#define BENCH_BARRIER()		asm volatile("" ::: "memory")
+#define BENCH_START()		do { BENCH_BARRIER(); GPIOR0=BENCH_CMD_START; BENCH_BARRIER(); } while(0)
+#define BENCH_STOP()		do { BENCH_BARRIER(); GPIOR0=BENCH_CMD_STOP; BENCH_BARRIER(); } while(0)
+
+#else
+
+void BenchHostMark(uint8_t cmd);
+
+#define BENCH_START()		BenchHostMark(BENCH_CMD_START)
+#define BENCH_STOP()		BenchHostMark(BENCH_CMD_STOP)
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// BenchInit
+///
+/// Prepare the machine for measurement. On the target there is nothing to do:
+/// Timer0 keeps running so that millis() and micros() work, and the runner
+/// subtracts the cycles of its overflow ISR from any measurement it lands in.
+/// On the host it puts the benchmark slave on the simulated IIC bus.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+void BenchInit(void);
+
+///////////////////////////////////////////////////////////////////////////////
+/// BenchBegin
+///
+/// Start a new named benchmark. Measurements up to the next BenchBegin are
+/// accumulated under this name.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+void BenchBegin(const char * name);
+
+///////////////////////////////////////////////////////////////////////////////
+/// BenchDerive
+///
+/// Register a derived figure. The structure must stay valid until BenchDone.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+void BenchDerive(const BENCHDERIVED * derived);
+
+///////////////////////////////////////////////////////////////////////////////
+/// BenchDone
+///
+/// Finish the run and write the report. Does not return.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+void BenchDone(void);
+
+#endif
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+###############################################################################
+## compare.py
+##
+## Compare two benchmark reports written by simbench (or the host build) and
+## print the change in every figure. Figures that grew by more than the
+## threshold are flagged; with --fail the exit status is nonzero if any did.
+##
+## Usage: compare.py [--threshold PCT] [--fail] previous.json current.json
+###############################################################################
+
+import argparse
+import json
+import os
+import sys
+
+
+def load(path):
+    if not os.path.exists(path):
+        return None
+    with open(path) as fp:
+        return json.load(fp)
+
+
+def figures(report):
+    out = {}
+    for key in ("flash_bytes", "ram_bytes"):
+        if report.get(key, -1) >= 0:
+            out[key] = report[key]
+    for name, value in report.get("benchmarks", {}).items():
+        if value is not None:
+            out[name] = value["mean"]
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--threshold", type=float, default=2.0,
+                    help="flag figures that grew by more than this percentage")
+    ap.add_argument("--fail", action="store_true",
+                    help="exit nonzero if any figure is flagged")
+    ap.add_argument("previous")
+    ap.add_argument("current")
+    args = ap.parse_args()
+
+    cur = load(args.current)
+    if cur is None:
+        sys.exit("no report at %s" % args.current)
+    prev = load(args.previous)
+
+    now = figures(cur)
+    before = figures(prev) if prev else {}
+    unit = cur.get("unit", "")
+    flagged = 0
+
+    print("%-28s %12s %12s %9s" % ("figure", "previous", "current", "change"))
+    for name, value in now.items():
+        label = "bytes" if name.endswith("_bytes") else unit
+        if name not in before:
+            print("%-28s %12s %12.1f %9s  %s" % (name, "-", value, "new", label))
+            continue
+        old = before[name]
+        pct = ((value - old) / old * 100.0) if old else 0.0
+        mark = ""
+        if pct > args.threshold:
+            mark = "  REGRESSION"
+            flagged += 1
+        print("%-28s %12.1f %12.1f %+8.1f%%  %s%s" % (name, old, value, pct, label, mark))
+
+    if flagged and args.fail:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+/// REPORT.CPP
+///
+/// Accumulates benchmark measurements and writes the JSON report
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "report.h"
+#include "benchmark.h"
+#include <string.h>
+
+BenchReport::BenchReport() : nEntries(0), current(-1), startMark(0), running(false), flash(-1), ram(-1)
+{
+}
+
+int BenchReport::Find(const char * name)
+{
+	for(int idx=0;idx<nEntries;idx++) {
+		if(!strcmp(entries[idx].name,name)) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+double BenchReport::Mean(int idx)
+{
+	if(idx<0 || !entries[idx].count) {
+		return 0.0;
+	}
+	return (double)entries[idx].total/entries[idx].count;
+}
+
+double BenchReport::Overhead(void)
+{
+	int idx=Find(BENCH_OVERHEAD);
+	return (idx<0 || !entries[idx].count)?0.0:(double)entries[idx].min;
+}
+
+void BenchReport::Begin(const char * name)
+{
+	running=false;
+	current=Find(name);
+	if((current<0) && (nEntries<REPORT_MAX_ENTRIES)) {
+		current=nEntries++;
+		memset(&entries[current],0,sizeof(ENTRY));
+		strncpy(entries[current].name,name,REPORT_MAX_NAME-1);
+		entries[current].min=UINT64_MAX;
+	}
+}
+
+void BenchReport::Start(uint64_t t)
+{
+	startMark=t;
+	running=(current>=0);
+}
+
+void BenchReport::Stop(uint64_t t)
+{
+	if(running) {
+		ENTRY * e=&entries[current];
+		uint64_t d=t-startMark;
+		e->total+=d;
+		e->count++;
+		if(d<e->min) e->min=d;
+		if(d>e->max) e->max=d;
+		running=false;
+	}
+}
+
+void BenchReport::Derive(const char * name, const char * minuend, const char * subtrahend, uint16_t divisor)
+{
+	Begin(name);
+	if(current>=0) {
+		ENTRY * e=&entries[current];
+		e->derived=true;
+		strncpy(e->minuend,minuend,REPORT_MAX_NAME-1);
+		strncpy(e->subtrahend,subtrahend,REPORT_MAX_NAME-1);
+		e->divisor=(divisor)?divisor:1;
+	}
+	current=-1;
+}
+
+void BenchReport::Footprint(long flashBytes, long ramBytes)
+{
+	flash=flashBytes;
+	ram=ramBytes;
+}
+
+void BenchReport::Write(FILE * fp, const char * target, const char * unit, unsigned long clockHz)
+{
+	double overhead=Overhead();
+	bool first=true;
+
+	fprintf(fp,"{\n  \"target\": \"%s\",\n  \"unit\": \"%s\",\n  \"clock_hz\": %lu,\n",target,unit,clockHz);
+	fprintf(fp,"  \"flash_bytes\": %ld,\n  \"ram_bytes\": %ld,\n",flash,ram);
+	fprintf(fp,"  \"overhead\": %.1f,\n  \"benchmarks\": {",overhead);
+	for(int idx=0;idx<nEntries;idx++) {
+		ENTRY * e=&entries[idx];
+		if(!strcmp(e->name,BENCH_OVERHEAD)) {
+			continue;
+		}
+		fprintf(fp,"%s\n    \"%s\": ",(first)?"":",",e->name);
+		first=false;
+		if(e->derived) {
+			double v=(Mean(Find(e->minuend))-Mean(Find(e->subtrahend)))/e->divisor;
+			fprintf(fp,"{ \"mean\": %.1f, \"derived\": \"(%s - %s) / %u\" }",v,e->minuend,e->subtrahend,e->divisor);
+		} else if(e->count) {
+			fprintf(fp,"{ \"mean\": %.1f, \"min\": %.1f, \"max\": %.1f, \"n\": %u }",
+					Mean(idx)-overhead,(double)e->min-overhead,(double)e->max-overhead,e->count);
+		} else {
+			fprintf(fp,"null");
+		}
+	}
+	fprintf(fp,"\n  }\n}\n");
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+/// REPORT.H
+///
+/// Accumulates benchmark measurements and writes the JSON report. Shared by
+/// the simavr runner (cycles) and the host build of the benchmarks
+/// (nanoseconds).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define REPORT_MAX_ENTRIES	48
+#define REPORT_MAX_NAME		32
+
+class BenchReport {
+
+	private:
+
+		struct ENTRY {
+			char		name[REPORT_MAX_NAME];
+			uint64_t	total;
+			uint64_t	min;
+			uint64_t	max;
+			uint32_t	count;
+			bool		derived;
+			char		minuend[REPORT_MAX_NAME];
+			char		subtrahend[REPORT_MAX_NAME];
+			uint16_t	divisor;
+		};
+
+		ENTRY		entries[REPORT_MAX_ENTRIES];
+		int			nEntries;
+		int			current;
+		uint64_t	startMark;
+		bool		running;
+		long		flash;
+		long		ram;
+
+		int Find(const char * name);
+		double Mean(int idx);
+		double Overhead(void);
+
+	public:
+
+		BenchReport();
+
+		/// start accumulating under a new name
+		void Begin(const char * name);
+
+		/// a START marker at time t
+		void Start(uint64_t t);
+
+		/// a STOP marker at time t
+		void Stop(uint64_t t);
+
+		/// register (mean(minuend)-mean(subtrahend))/divisor
+		void Derive(const char * name, const char * minuend, const char * subtrahend, uint16_t divisor);
+
+		/// static footprint of the firmware, bytes. Negative if unknown
+		void Footprint(long flashBytes, long ramBytes);
+
+		/// write the JSON report
+		void Write(FILE * fp, const char * target, const char * unit, unsigned long clockHz);
+};
+
+#endif
@@ -0,0 +1,260 @@
+///////////////////////////////////////////////////////////////////////////////
+/// SIMBENCH.CPP
+///
+/// simavr runner for the kernel benchmark firmware
+///
+/// Loads the benchmark ELF into a simulated ATMega328p, traps the marker
+/// writes to GPIOR0 to read the exact cycle counter, leaves the Timer0
+/// overflow interrupt out of the measurements, puts an always-ACK slave
+/// on the TWI bus for the IIC benchmarks and writes the JSON report with the
+/// static flash and RAM footprint taken from the ELF.
+///
+/// Usage: simbench [-m mcu] [-f hz] [-o report.json] [-s footprint.elf]
+///                 [-c max_cycles] bench.elf
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_twi.h"
+}
+
+#include "benchmark.h"
+#include "report.h"
+
+// ATMega328p general purpose I/O registers, data space addresses
+
+#define GPIOR0_ADDR		0x3e
+#define GPIOR1_ADDR		0x4a
+#define GPIOR2_ADDR		0x4b
+
+#define SLAVE_ADDR		0xa0
+
+// ATMega328p TIMER0_OVF vector number
+
+#define TIMER0_OVF_VECT	16
+
+static BenchReport	report;
+static bool			done=false;
+
+static avr_cycle_count_t	tickCycles;		// spent in the Timer0 overflow ISR so far
+static avr_cycle_count_t	tickEntered;
+
+static avr_irq_t *	slaveIrq;
+static uint8_t		slaveSelected;
+
+///////////////////////////////////////////////////////////////////////////////
+/// ReadString
+///
+/// Copy a NUL terminated string out of target SRAM
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void ReadString(avr_t * avr, uint16_t addr, char * buf, size_t len)
+{
+	size_t idx=0;
+	while((idx<len-1) && (addr+idx<=avr->ramend) && avr->data[addr+idx]) {
+		buf[idx]=avr->data[addr+idx];
+		idx++;
+	}
+	buf[idx]=0;
+}
+
+static uint16_t ReadWord(avr_t * avr, uint16_t addr)
+{
+	return avr->data[addr] | (avr->data[addr+1]<<8);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// TickHook
+///
+/// Timer0 overflow vector entered (1) or returned from (0). Timer0 is left
+/// running so that millis() and micros(), and the loop budget and IIC
+/// timeouts built on them, behave as in the application; the cycles its ISR
+/// takes are kept out of the measurements instead. The few cycles of the
+/// interrupt response and of RETI itself still count.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void TickHook(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	avr_t * avr=(avr_t *)param;
+
+	if(value) {
+		tickEntered=avr->cycle;
+	} else {
+		tickCycles+=avr->cycle-tickEntered;
+	}
+}
+
+// the cycle counter less the Timer0 ISR
+
+static uint64_t BenchCycles(avr_t * avr)
+{
+	return avr->cycle-tickCycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// MarkerWrite
+///
+/// GPIOR0 write hook: the firmware's benchmark commands
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void MarkerWrite(avr_t * avr, avr_io_addr_t addr, uint8_t v, void * param)
+{
+	uint16_t arg=avr->data[GPIOR1_ADDR] | (avr->data[GPIOR2_ADDR]<<8);
+	char name[REPORT_MAX_NAME], minuend[REPORT_MAX_NAME], subtrahend[REPORT_MAX_NAME];
+
+	avr->data[addr]=v;
+	switch(v) {
+		case BENCH_CMD_START:
+			report.Start(BenchCycles(avr));
+			break;
+		case BENCH_CMD_STOP:
+			report.Stop(BenchCycles(avr));
+			break;
+		case BENCH_CMD_BEGIN:
+			ReadString(avr,arg,name,sizeof(name));
+			report.Begin(name);
+			break;
+		case BENCH_CMD_DERIVE:
+			ReadString(avr,ReadWord(avr,arg),name,sizeof(name));
+			ReadString(avr,ReadWord(avr,arg+2),minuend,sizeof(minuend));
+			ReadString(avr,ReadWord(avr,arg+4),subtrahend,sizeof(subtrahend));
+			report.Derive(name,minuend,subtrahend,ReadWord(avr,arg+6));
+			break;
+		case BENCH_CMD_DONE:
+			done=true;
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// SlaveHook
+///
+/// TWI slave that acknowledges everything addressed to SLAVE_ADDR and reads
+/// back 0xff
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void SlaveHook(struct avr_irq_t * irq, uint32_t value, void * param)
+{
+	avr_twi_msg_irq_t v;
+	v.u.v=value;
+
+	if(v.u.twi.msg & TWI_COND_STOP) {
+		slaveSelected=0;
+	}
+	if(v.u.twi.msg & TWI_COND_START) {
+		slaveSelected=0;
+		if((v.u.twi.addr & 0xfe)==SLAVE_ADDR) {
+			slaveSelected=v.u.twi.addr;
+			avr_raise_irq(slaveIrq+TWI_IRQ_INPUT,avr_twi_irq_msg(TWI_COND_ACK,slaveSelected,1));
+		}
+	}
+	if(slaveSelected) {
+		if(v.u.twi.msg & TWI_COND_WRITE) {
+			avr_raise_irq(slaveIrq+TWI_IRQ_INPUT,avr_twi_irq_msg(TWI_COND_ACK,slaveSelected,1));
+		}
+		if(v.u.twi.msg & TWI_COND_READ) {
+			avr_raise_irq(slaveIrq+TWI_IRQ_INPUT,avr_twi_irq_msg(TWI_COND_READ,slaveSelected,0xff));
+		}
+	}
+}
+
+static void SlaveAttach(avr_t * avr)
+{
+	static const char * names[2]={ "8>bench.slave.in", "32<bench.slave.out" };
+	uint32_t base=AVR_IOCTL_TWI_GETIRQ(0);
+
+	slaveIrq=avr_alloc_irq(&avr->irq_pool,0,2,names);
+	avr_irq_register_notify(slaveIrq+TWI_IRQ_OUTPUT,SlaveHook,NULL);
+	avr_connect_irq(slaveIrq+TWI_IRQ_INPUT,avr_io_getirq(avr,base,TWI_IRQ_INPUT));
+	avr_connect_irq(avr_io_getirq(avr,base,TWI_IRQ_OUTPUT),slaveIrq+TWI_IRQ_OUTPUT);
+}
+
+int main(int argc, char ** argv)
+{
+	const char *		mcu="atmega328p";
+	unsigned long		freq=16000000UL;
+	const char *		out=NULL;
+	const char *		footprint=NULL;
+	avr_cycle_count_t	maxCycles=4000000000ULL;
+	elf_firmware_t		fw;
+	int					opt;
+
+	while((opt=getopt(argc,argv,"m:f:o:s:c:"))!=-1) {
+		switch(opt) {
+			case 'm':	mcu=optarg; break;
+			case 'f':	freq=strtoul(optarg,NULL,0); break;
+			case 'o':	out=optarg; break;
+			case 's':	footprint=optarg; break;
+			case 'c':	maxCycles=strtoull(optarg,NULL,0); break;
+			default:
+				fprintf(stderr,"usage: %s [-m mcu] [-f hz] [-o report.json] [-s footprint.elf] [-c max_cycles] bench.elf\n",argv[0]);
+				return 1;
+		}
+	}
+	if(optind>=argc) {
+		fprintf(stderr,"%s: no firmware given\n",argv[0]);
+		return 1;
+	}
+
+	// static footprint: flash is text+data, RAM is data+bss
+
+	memset(&fw,0,sizeof(fw));
+	if(elf_read_firmware((footprint)?footprint:argv[optind],&fw)) {
+		fprintf(stderr,"%s: can't read %s\n",argv[0],(footprint)?footprint:argv[optind]);
+		return 1;
+	}
+	report.Footprint(fw.flashsize,fw.datasize+fw.bsssize);
+	if(footprint) {
+		memset(&fw,0,sizeof(fw));
+		if(elf_read_firmware(argv[optind],&fw)) {
+			fprintf(stderr,"%s: can't read %s\n",argv[0],argv[optind]);
+			return 1;
+		}
+	}
+
+	avr_t * avr=avr_make_mcu_by_name(mcu);
+	if(!avr) {
+		fprintf(stderr,"%s: unknown mcu %s\n",argv[0],mcu);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr,&fw);
+	avr->frequency=freq;
+
+	avr_register_io_write(avr,GPIOR0_ADDR,MarkerWrite,NULL);
+	avr_irq_register_notify(avr_get_interrupt_irq(avr,TIMER0_OVF_VECT)+AVR_INT_IRQ_RUNNING,TickHook,avr);
+	SlaveAttach(avr);
+
+	int state=cpu_Running;
+	while(!done && (state!=cpu_Done) && (state!=cpu_Crashed) && (avr->cycle<maxCycles)) {
+		state=avr_run(avr);
+	}
+	if(!done) {
+		fprintf(stderr,"%s: firmware stopped before completing (state %d, cycle %llu)\n",
+				argv[0],state,(unsigned long long)avr->cycle);
+		return 2;
+	}
+
+	FILE * fp=(out)?fopen(out,"w"):stdout;
+	if(!fp) {
+		perror(out);
+		return 1;
+	}
+	report.Write(fp,mcu,"cycles",freq);
+	if(fp!=stdout) {
+		fclose(fp);
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////
+/// ARDUINO.H (host)
+///
+/// Host (Linux) stand-in for the Arduino AVR core. The kernel treats the
+/// Arduino core as its hardware abstraction layer: time comes from millis()
+/// and micros(), interrupt masking from cli()/sei() and SREG, and peripherals
+/// are driven through their special function registers. This header provides
+/// the same names on the host, backed by the simulator in host/sim, so the
+/// kernel and application sources build unmodified.
+///
+/// Time is virtual. It only moves when the simulator is told to advance it
+/// (see sim.h), so a run is deterministic and can go as fast as the host
+/// CPU allows.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef bool	boolean;
+typedef uint8_t	byte;
+
+#define HIGH	0x1
+#define LOW		0x0
+
+#define SERIAL_TX_BUFFER_SIZE	64
+
+#define DEC		10
+#define HEX		16
+
+#define _BV(bit) (1 << (bit))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// sketch entry points, provided by the kernel
+
+	void setup(void);
+	void loop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// Time
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+///////////////////////////////////////////////////////////////////////////////
+/// Interrupts
+///
+/// cli()/sei() act on the I bit of the simulated SREG. Pending interrupts are
+/// delivered whenever the I bit is set and the simulator reaches a service
+/// point (sei, SREG write, time advance).
+///////////////////////////////////////////////////////////////////////////////
+
+void cli(void);
+void sei(void);
+
+#define interrupts()	sei()
+#define noInterrupts()	cli()
+
+#define ISR(vector, ...)	extern "C" void vector(void)
+
+///////////////////////////////////////////////////////////////////////////////
+/// SimReg
+///
+/// An 8-bit special function register. Reads and writes may be hooked by the
+/// simulator so that peripherals react to register access the way the real
+/// silicon does.
+///////////////////////////////////////////////////////////////////////////////
+
+class SimReg {
+
+	public:
+
+		typedef uint8_t (*PFNREAD)(SimReg& reg);
+		typedef void (*PFNWRITE)(SimReg& reg, uint8_t value);
+
+		uint8_t		value;
+		PFNREAD		onRead;
+		PFNWRITE	onWrite;
+
+		SimReg(uint8_t init=0, PFNREAD rd=NULL, PFNWRITE wr=NULL) : value(init), onRead(rd), onWrite(wr) {};
+
+		operator uint8_t() { return (onRead)?onRead(*this):value; };
+
+		SimReg& operator=(uint8_t v) { if(onWrite) onWrite(*this,v); else value=v; return *this; };
+		SimReg& operator=(SimReg& r) { return *this=(uint8_t)r; };
+		SimReg& operator|=(uint8_t v) { return *this=(uint8_t)(((uint8_t)*this)|v); };
+		SimReg& operator&=(uint8_t v) { return *this=(uint8_t)(((uint8_t)*this)&v); };
+		SimReg& operator^=(uint8_t v) { return *this=(uint8_t)(((uint8_t)*this)^v); };
+};
+
+// status register
+
+extern SimReg SREG;
+
+#define SREG_I	7
+
+// GPIO
+
+extern SimReg PORTB, DDRB, PINB;
+extern SimReg PORTC, DDRC, PINC;
+
+#define PC4		4		// SDA
+#define PC5		5		// SCL
+
+// TWI
+
+extern SimReg TWBR, TWSR, TWDR, TWCR, TWAR, TWAMR;
+
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+
+#define TWPS1	1
+#define TWPS0	0
+
+///////////////////////////////////////////////////////////////////////////////
+/// HardwareSerial
+///
+/// Serial port. Output goes to stdout unless muted by the simulator, at the
+/// rate begin() sets in virtual time.
+///////////////////////////////////////////////////////////////////////////////
+
+class HardwareSerial {
+
+	public:
+
+		void begin(unsigned long baud);
+		void flush(void);
+
+		size_t write(uint8_t c);
+		size_t write(const char * str);
+		size_t write(const uint8_t * buf, size_t size);
+		int availableForWrite(void);
+
+		size_t print(const char * str);
+		size_t print(char c);
+		size_t print(int n, int base=DEC);
+		size_t print(unsigned int n, int base=DEC);
+		size_t print(long n, int base=DEC);
+		size_t print(unsigned long n, int base=DEC);
+		size_t print(double n, int digits=2);
+
+		size_t println(void);
+		size_t println(const char * str);
+		size_t println(char c);
+		size_t println(int n, int base=DEC);
+		size_t println(unsigned int n, int base=DEC);
+		size_t println(long n, int base=DEC);
+		size_t println(unsigned long n, int base=DEC);
+		size_t println(double n, int digits=2);
+};
+
+extern HardwareSerial Serial;
+
+#endif
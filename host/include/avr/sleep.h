@@ -0,0 +1,27 @@
+///////////////////////////////////////////////////////////////////////////////
+/// AVR/SLEEP.H
+///
+/// Host stand-in for avr-libc's sleep interface. The simulated CPU has no
+/// power modes to choose from: sleep_cpu() moves virtual time straight on to
+/// the next event that would wake a sleeping AVR - the next Timer 0 tick
+/// behind millis() - and delivers any interrupt that is then pending.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _HOST_AVR_SLEEP_H_
+#define _HOST_AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			1
+#define SLEEP_MODE_PWR_DOWN		2
+#define SLEEP_MODE_PWR_SAVE		3
+#define SLEEP_MODE_STANDBY		6
+#define SLEEP_MODE_EXT_STANDBY	7
+
+#define set_sleep_mode(mode)	((void)(mode))
+#define sleep_enable()			((void)0)
+#define sleep_disable()			((void)0)
+
+extern void sleep_cpu(void);
+
+#endif
@@ -0,0 +1,302 @@
+///////////////////////////////////////////////////////////////////////////////
+/// LOGCHECK.CPP
+///
+/// Cross-check of the LogData head search. Builds 24LC512 images through the
+/// application's LogData on the simulated bus: blank, partly filled, wrapped,
+/// and with the head page, the oldest page or page 0 torn. For each, checks
+/// that LogData::Head() and Tail(), which bisect the page headers, agree with
+/// logdecode, which scans every page, on the same image. Then, with the serial
+/// port at the board's baud rate, checks that ReadAll prints the records
+/// logdecode finds and that Export sends the image byte for byte, no faster
+/// than the port can, and reports how long each blocks for.
+///
+/// Usage: logcheck logdecode image
+///
+///   logdecode  the decoder to compare with
+///   image      scratch file for the images
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "devices.h"
+#include "kernel.h"
+#include "LogData.h"
+
+#define LOGCHECK_BAUD		115200		// as ENDG3051_APP.ino
+#define LOGCHECK_CHAR_US	(10e6/LOGCHECK_BAUD)
+
+static Sim::EEPROM24LC512	eeprom(0xA0);
+
+static const char *			decoder;
+static const char *			image;
+static int					failures;
+
+// no application: LogData is driven from main()
+
+void UserInit(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Append
+///
+/// Append records to the log in the image, as a freshly started LogData
+/// would, and return the head slot after them
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static int Append(int count)
+{
+	static uint32_t time;
+	LogData log;
+	LOGRECORD rec={ 0, 1, { 0, 0 } };
+
+	log.SetFlushLatency(0);
+	for(int idx=0;idx<count;idx++) {
+		rec.time=time++;
+		log.Append(rec);
+	}
+	log.Flush();
+	delay(E2_WRITE_MS+1);				// let the last write cycle finish
+	return log.Head();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Tear
+///
+/// Spoil the header of a page, as a write cut short by a reset would
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void Tear(int page)
+{
+	memset(&eeprom.mem[page*E2_PAGE],0x00,LOG_PAGE_HEADER/2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Decode
+///
+/// Run logdecode on the image as it stands. Returns its output, for pclose
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static FILE * Decode(void)
+{
+	char cmd[256];
+
+	FILE * fp=fopen(image,"wb");
+	if(!fp || (fwrite(eeprom.mem,1,sizeof(eeprom.mem),fp)!=sizeof(eeprom.mem))) {
+		fprintf(stderr,"logcheck: cannot write %s\n",image);
+		exit(1);
+	}
+	fclose(fp);
+
+	snprintf(cmd,sizeof(cmd),"%s %s",decoder,image);
+	fp=popen(cmd,"r");
+	if(!fp) {
+		fprintf(stderr,"logcheck: cannot run %s\n",cmd);
+		exit(1);
+	}
+	return fp;
+}
+
+static void Result(bool ok)
+{
+	if(!ok) {
+		failures++;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Check
+///
+/// Compare a fresh LogData's head and tail with logdecode's on the image as
+/// it stands. Returns the head slot
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static int Check(const char * name)
+{
+	char line[128];
+	int head, tail, decodedHead=-1, decodedTail=-1;
+
+	LogData log;
+	head=log.Head();
+	tail=log.Tail();
+
+	FILE * fp=Decode();
+	while(fgets(line,sizeof(line),fp)) {
+		sscanf(line,"# head slot %d, tail slot %d",&decodedHead,&decodedTail);
+	}
+	pclose(fp);
+
+	bool ok=(head==decodedHead) && (tail==decodedTail);
+	printf("logcheck: %-18s head %5d tail %5d, logdecode head %5d tail %5d  %s\n",
+			name,head,tail,decodedHead,decodedTail,(ok)?"ok":"FAILED");
+	Result(ok);
+	return head;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Capture
+///
+/// Start or finish capturing the serial port. Finishing waits for the port to
+/// send what is buffered, and returns the virtual time since the start in us
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t captureStart;
+
+static FILE * Capture(void)
+{
+	FILE * fp=tmpfile();
+	Sim::SerialCapture(fp);
+	Sim::SerialEcho(true);
+	captureStart=Sim::Now();
+	return fp;
+}
+
+static uint64_t Captured(FILE * fp)
+{
+	Serial.flush();
+	Sim::SerialEcho(false);
+	Sim::SerialCapture(NULL);
+	rewind(fp);
+	return Sim::Now()-captureStart;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// CheckReadAll
+///
+/// ReadAll should print the records logdecode finds, in the same order
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void CheckReadAll(void)
+{
+	char line[128], printed[128];
+	unsigned long records=0, bytes=0;
+	bool same=true;
+
+	LogData log;
+	FILE * out=Capture();
+	int rc=log.ReadAll();
+	uint64_t us=Captured(out);
+
+	// logdecode prefixes each record with its page sequence and slot
+
+	FILE * fp=Decode();
+	while(fgets(line,sizeof(line),fp)) {
+		if(line[0]=='#') {
+			continue;
+		}
+		const char * rec=strchr(line,',');
+		rec=(rec)?strchr(rec+1,','):NULL;
+		if(!rec || !fgets(printed,sizeof(printed),out) || strcmp(rec+1,printed)) {
+			same=false;
+			break;
+		}
+		records++;
+		bytes+=strlen(printed);
+	}
+	pclose(fp);
+	if(fgets(printed,sizeof(printed),out)) {
+		same=false;					// printed more
+	}
+	fclose(out);
+
+	bool ok=(rc==0) && same && (us>=bytes*LOGCHECK_CHAR_US);
+	printf("logcheck: ReadAll rc %d, %lu records %s logdecode, %lu bytes in %.1f ms at %lu baud  %s\n",
+			rc,records,(same)?"as":"differ from",bytes,us/1000.0,(unsigned long)LOGCHECK_BAUD,(ok)?"ok":"FAILED");
+	Result(ok);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// CheckExport
+///
+/// Export should send the image as it is
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static void CheckExport(void)
+{
+	static uint8_t sent[sizeof(eeprom.mem)+1];
+
+	LogData log;
+	log.Head();
+	FILE * out=Capture();
+	int rc=log.Export();
+	uint64_t us=Captured(out);
+	size_t len=fread(sent,1,sizeof(sent),out);
+	fclose(out);
+
+	bool same=(len==sizeof(eeprom.mem)) && !memcmp(sent,eeprom.mem,len);
+	bool ok=(rc==0) && same && (us>=len*LOGCHECK_CHAR_US);
+	printf("logcheck: Export rc %d, %lu bytes %s the image, in %.1f ms at %lu baud  %s\n",
+			rc,(unsigned long)len,(same)?"as":"differ from",us/1000.0,(unsigned long)LOGCHECK_BAUD,(ok)?"ok":"FAILED");
+	Result(ok);
+}
+
+int main(int argc, char ** argv)
+{
+	int head;
+
+	if(argc!=3) {
+		fprintf(stderr,"usage: %s logdecode image\n",argv[0]);
+		return 1;
+	}
+	decoder=argv[1];
+	image=argv[2];
+
+	Sim::IICAttach(&eeprom);
+	Sim::SerialEcho(false);
+	sei();
+	setup();
+
+	Check("blank");
+
+	Append(1);
+	Check("one record");
+	Append(100*LOG_PER_PAGE+4);
+	Check("partly filled");
+
+	// the head page is torn: the page before it is the head
+
+	head=Append(LOG_PER_PAGE/2);
+	Tear(head/LOG_PER_PAGE);
+	head=Check("torn head");
+
+	Append(LOG_RECORDS-head);
+	Check("one lap");
+	Append(5);
+	Check("wrapped");
+	head=Append(300*LOG_PER_PAGE);
+	Check("wrapped further");
+
+	// the oldest page, the next to be overwritten, is torn
+
+	Tear((head/LOG_PER_PAGE+1)%LOG_PAGES);
+	Check("torn oldest");
+
+	// the ring has just wrapped to page 0 and it is torn: the head is the last page
+
+	head=Append(LOG_RECORDS-head-1);
+	Check("head at last page");
+	Append(2);
+	Tear(0);
+	Check("torn page 0");
+
+	// a log with a lap and a bit in it, read out through the port
+
+	Serial.begin(LOGCHECK_BAUD);
+	Append(LOG_RECORDS+100);
+	CheckReadAll();
+	CheckExport();
+
+	printf("logcheck: %d failed\n",failures);
+	return (failures)?1:0;
+}
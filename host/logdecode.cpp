@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+/// LOGDECODE.CPP
+///
+/// Decode the LogData log in a 24LC512 image, such as kernel_host -e saves.
+/// Finds the head of the ring as LogData does, then prints every valid
+/// record oldest first, as page sequence, slot, record, using the
+/// application's own LogRecord code. The last line gives the record slots
+/// LogData::Head() and LogData::Tail() should report for the image.
+///
+/// Usage: logdecode image
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include "LogRecord.h"
+
+static uint8_t image[65536];
+
+int main(int argc, char ** argv)
+{
+	LOGPAGE page;
+	LOGRECORD rec;
+	char line[64];
+	unsigned long valid=0;
+	int head=-1, first, filled=0;
+	uint32_t headSeq=0;
+	uint16_t headSpan=0;
+
+	if(argc!=2) {
+		fprintf(stderr,"usage: %s image\n",argv[0]);
+		return 1;
+	}
+	FILE * fp=fopen(argv[1],"rb");
+	if(!fp || (fread(image,1,sizeof(image),fp)!=sizeof(image))) {
+		fprintf(stderr,"%s: cannot read a 64 KB image from %s\n",argv[0],argv[1]);
+		return 1;
+	}
+	fclose(fp);
+
+	// the head has the highest sequence number, and its span says how many
+	// pages back the log starts: the page after it, or the latest reset
+
+	for(int pg=0;pg<LOG_PAGES;pg++) {
+		if(!LogDecodePage(&image[pg*E2_PAGE],&page)) {
+			continue;
+		}
+		if((head<0) || (page.seq>headSeq)) {
+			head=pg;
+			headSeq=page.seq;
+			headSpan=page.span;
+		}
+	}
+	if(head<0) {
+		printf("# no log pages\n");
+		printf("# head slot 0, tail slot 0\n");
+		return 0;
+	}
+	first=(head+LOG_PAGES-headSpan+1)%LOG_PAGES;
+	printf("# log version %u, head page %d sequence %lu, oldest page %d\n",LOG_VERSION,head,(unsigned long)headSeq,first);
+
+	for(int pg=first;;pg=(pg+1)%LOG_PAGES) {
+		const uint8_t * data=&image[pg*E2_PAGE];
+		if(LogDecodePage(data,&page)) {
+			for(int slot=0;slot<LOG_PER_PAGE;slot++) {
+				if(LogDecode(&data[LOG_PAGE_HEADER+slot*LOG_RECORD_SIZE],&rec)) {
+					LogFormat(&rec,line,sizeof(line));
+					printf("%lu,%d,%s",(unsigned long)page.seq,pg*LOG_PER_PAGE+slot,line);
+					valid++;
+				}
+			}
+		}
+		if(pg==head) {
+			break;
+		}
+	}
+	printf("# %lu records\n",valid);
+
+	// appending resumes after the records at the start of the head page
+
+	while((filled<LOG_PER_PAGE) && LogDecode(&image[head*E2_PAGE+LOG_PAGE_HEADER+filled*LOG_RECORD_SIZE],&rec)) {
+		filled++;
+	}
+	printf("# head slot %d, tail slot %d\n",
+			(filled==LOG_PER_PAGE)?((head+1)%LOG_PAGES)*LOG_PER_PAGE:head*LOG_PER_PAGE+filled,first*LOG_PER_PAGE);
+	return 0;
+}
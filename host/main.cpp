@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+/// MAIN.CPP
+///
+/// Host driver. Plays the part of the Arduino core's main(): enables
+/// interrupts, calls the kernel's setup() once and then loop() repeatedly,
+/// moving virtual time forward after every pass to account for the CPU time
+/// the pass would have taken on the target. The board's 24LC512 EEPROM and
+/// MCP7940 RTC are modelled on the IIC bus. Kernel loop statistics, bus use
+/// and pool occupancy are reported at the end of the run.
+///
+/// Usage: kernel_host [-t run_ms] [-p pass_us] [-q] [-g] [-i] [-e image]
+///
+///   -t  virtual time to run for, in milliseconds (default 10000)
+///   -p  virtual time charged per loop() pass, in microseconds (default 10)
+///   -q  do not echo the serial port
+///   -g  trace GPIO port writes to stderr
+///   -i  instant IIC bus: no bus timing
+///   -e  EEPROM image file: loaded at start if it exists, saved at the end
+///       (decode the log in it with logdecode)
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "devices.h"
+#include "pool.h"
+#include "kernel.h"
+
+// the devices on the board
+
+static Sim::EEPROM24LC512	eeprom(0xA0);
+static Sim::MCP7940			rtc(0xDE);
+
+static double WallMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000.0+ts.tv_nsec/1e6;
+}
+
+int main(int argc, char ** argv)
+{
+	unsigned long	runMs=10000;
+	unsigned long	passUs=10;
+	unsigned long	passes=0;
+	const char *	image=NULL;
+	int				opt;
+
+	while((opt=getopt(argc,argv,"t:p:qgie:"))!=-1) {
+		switch(opt) {
+			case 't':	runMs=strtoul(optarg,NULL,0); break;
+			case 'p':	passUs=strtoul(optarg,NULL,0); break;
+			case 'q':	Sim::SerialEcho(false); break;
+			case 'g':	Sim::GPIOTrace(true); break;
+			case 'i':	Sim::IICTiming(false); break;
+			case 'e':	image=optarg; break;
+			default:
+				fprintf(stderr,"usage: %s [-t run_ms] [-p pass_us] [-q] [-g] [-i] [-e image]\n",argv[0]);
+				return 1;
+		}
+	}
+
+	if(image) {
+		FILE * fp=fopen(image,"rb");
+		if(fp) {
+			fread(eeprom.mem,1,sizeof(eeprom.mem),fp);
+			fclose(fp);
+		}
+	}
+	Sim::IICAttach(&eeprom);
+	Sim::IICAttach(&rtc);
+
+	double wallStart=WallMs();
+	uint64_t end=(uint64_t)runMs*1000;
+
+	sei();
+	setup();
+	while(Sim::Now()<end) {
+		loop();
+		Sim::Advance(passUs);
+		passes++;
+	}
+
+	double wall=WallMs()-wallStart;
+	fflush(stdout);
+	if(image) {
+		FILE * fp=fopen(image,"wb");
+		if(!fp || (fwrite(eeprom.mem,1,sizeof(eeprom.mem),fp)!=sizeof(eeprom.mem))) {
+			fprintf(stderr,"sim: cannot save EEPROM image %s\n",image);
+		}
+		if(fp) {
+			fclose(fp);
+		}
+	}
+	fprintf(stderr,"sim: %.3f ms virtual, %lu passes, %.3f ms wall, %.0fx real time\n",
+			Sim::Now()/1000.0,passes,wall,(wall>0)?(Sim::Now()/1000.0)/wall:0.0);
+	const Kernel::KERNELSTATS& ks=Kernel::OS.Stats();
+	fprintf(stderr,"sim: kernel %lu passes, %lu timers, %lu messages, %lu task steps, max queue %u, "
+			"budget %u us, %u overruns, longest pass %u us, message share %u/256\n",
+			(unsigned long)ks.passes,(unsigned long)ks.timers,(unsigned long)ks.messages,(unsigned long)ks.tasks,ks.maxPending,
+			Kernel::OS.GetPassBudget(),ks.overruns,ks.maxPassUs,ks.msgShare);
+	fprintf(stderr,"sim: kernel slept %lu times, %.1f%% of virtual time\n",
+			(unsigned long)ks.sleeps,Sim::Now()?100.0*Sim::Slept()/Sim::Now():0.0);
+	const Kernel::IICSTATS& is=Kernel::OS.IICDriver.Stats();
+	fprintf(stderr,"sim: iic %lu transactions, %lu errors, %lu timeouts, %lu recoveries, %lu polls, longest %lu us\n",
+			is.transactions,is.errors,is.timeouts,is.recoveries,is.polls,is.maxLatencyUs);
+	fprintf(stderr,"sim: iic bus busy %.1f%% of virtual time, eeprom %lu page writes, %lu busy NACKs\n",
+			Sim::Now()?100.0*Sim::IICBusy()/Sim::Now():0.0,eeprom.pageWrites,eeprom.busyNacks);
+	fprintf(stderr,"sim: iic clock profiles 100k %lu Hz, 400k %lu Hz, 1M %lu Hz\n",
+			Kernel::IIC::Rate(Kernel::IIC_SPEED_100K),Kernel::IIC::Rate(Kernel::IIC_SPEED_400K),Kernel::IIC::Rate(Kernel::IIC_SPEED_1M));
+#if IIC_TRACE
+	const Kernel::IICTRACESTATS& ts=Kernel::OS.IICDriver.TraceStats();
+	fprintf(stderr,"sim: iic trace busy %u%%, %lu NACKs, %lu errors, latency us <64:%lu <128:%lu <256:%lu <512:%lu <1k:%lu <2k:%lu <4k:%lu more:%lu\n",
+			Kernel::OS.IICDriver.BusyPercent(),ts.nacks,ts.errors,ts.latency[0],ts.latency[1],ts.latency[2],ts.latency[3],
+			ts.latency[4],ts.latency[5],ts.latency[6],ts.latency[7]);
+	for(int idx=0;(idx<IIC_TRACE_DEVICES) && ts.devices[idx].addr;idx++) {
+		const Kernel::IICDEVTRACE& dev=ts.devices[idx];
+		fprintf(stderr,"sim: iic trace 0x%02x %lu transactions, %lu bytes (%lu B/s), %lu NACKs, %lu errors, busy %lu us\n",
+				dev.addr,dev.transactions,dev.bytes,Kernel::OS.IICDriver.BytesPerSecond(dev.addr),dev.nacks,dev.errors,dev.busyUs);
+	}
+#endif
+	for(const Kernel::PoolBase * pool=Kernel::PoolBase::First();pool;pool=pool->Next()) {
+		fprintf(stderr,"sim: pool %-12s %3u/%-3u used, high water %u, %u failed\n",
+				pool->Name(),pool->Used(),pool->Capacity(),pool->HighWater(),pool->Failures());
+	}
+	return 0;
+}
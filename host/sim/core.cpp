@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+/// CORE.CPP
+///
+/// Simulated CPU core: virtual clock, global interrupt flag, interrupt
+/// delivery and the GPIO ports
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include "sim.h"
+#include "simint.h"
+
+namespace Sim {
+
+	static uint64_t	simTime=0;			// virtual time, us
+	static uint64_t	sleptTime=0;		// virtual time spent in sleep_cpu, us
+	static bool		inISR=false;
+	static bool		gpioTrace=false;
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Now
+	///
+	/// Current virtual time in microseconds since reset
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t Now(void)
+	{
+		return simTime;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Advance
+	///
+	/// Move virtual time forward, completing bus actions as their time comes
+	/// and servicing interrupts
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Advance(uint64_t us)
+	{
+		uint64_t target=simTime+us;
+		uint64_t next;
+
+		while((next=TWINextEvent())<=target) {
+			simTime=next;
+			TWIEvent();
+			ServiceInterrupts();
+		}
+		simTime=target;
+		ServiceInterrupts();
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Sleep
+	///
+	/// The CPU sleeps until the next interrupt. On the target, Timer 0 overflows
+	/// every millisecond or so to update millis(); that is the latest a sleep
+	/// can last, and it is the tick the kernel's deadlines are measured in, so
+	/// we wake on the next whole millisecond, or sooner when a bus action
+	/// completes. Sleeping with interrupts disabled would never wake.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Sleep(void)
+	{
+		if(!(SREG.value & _BV(SREG_I))) {
+			fprintf(stderr,"sim: sleep with interrupts disabled\n");
+			exit(2);
+		}
+		uint64_t wake=(simTime/1000+1)*1000;
+		if(TWINextEvent()<wake) {
+			wake=TWINextEvent();
+		}
+		sleptTime+=wake-simTime;
+		Advance(wake-simTime);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Slept
+	///
+	/// Total virtual time spent asleep
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t Slept(void)
+	{
+		return sleptTime;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// ServiceInterrupts
+	///
+	/// Deliver pending interrupts. As on the AVR, the I bit is cleared on entry to
+	/// a handler and set again on return, so handlers do not nest. The TWI
+	/// interrupt is level triggered on TWINT: a handler that neither clears TWINT
+	/// nor disables TWIE would lock up real hardware, so we stop the run.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void ServiceInterrupts(void)
+	{
+		unsigned long spins=0;
+
+		if(inISR) {
+			return;
+		}
+		while((SREG.value & _BV(SREG_I)) && TWIInterruptPending() && TWI_vect) {
+			if(++spins>1000000UL) {
+				fprintf(stderr,"sim: TWI interrupt never acknowledged\n");
+				exit(2);
+			}
+			inISR=true;
+			SREG.value&=~_BV(SREG_I);
+			TWI_vect();
+			SREG.value|=_BV(SREG_I);
+			inISR=false;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// GPIOTrace
+	///
+	/// Enable or disable logging of output port writes to stderr
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void GPIOTrace(bool trace)
+	{
+		gpioTrace=trace;
+	}
+
+	//
+	// register hooks
+
+	static void SREGWrite(SimReg& reg, uint8_t value)
+	{
+		reg.value=value;
+		ServiceInterrupts();
+	}
+
+	static uint8_t PINCRead(SimReg& /*reg*/)
+	{
+		// the IIC lines have pull-ups and are only ever driven low
+
+		uint8_t iic=_BV(PC4) | _BV(PC5);
+		uint8_t pins=(PORTC.value & ~iic) | (iic & ~(DDRC.value & ~PORTC.value));
+
+		return pins & ~IICLinesLow();
+	}
+
+	static void DDRCWrite(SimReg& reg, uint8_t value)
+	{
+		IICDirection(reg.value,value);
+		reg.value=value;
+	}
+
+	static void PortWrite(SimReg& reg, uint8_t value)
+	{
+		if(gpioTrace && (value!=reg.value)) {
+			fprintf(stderr,"[%10.3f ms] %s=0x%02x\n",simTime/1000.0,(&reg==&PORTB)?"PORTB":"PORTC",value);
+		}
+		reg.value=value;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Registers
+///////////////////////////////////////////////////////////////////////////////
+
+SimReg SREG(0,NULL,Sim::SREGWrite);
+
+SimReg PORTB(0,NULL,Sim::PortWrite), DDRB, PINB;
+SimReg PORTC(0,NULL,Sim::PortWrite), DDRC(0,NULL,Sim::DDRCWrite), PINC(0,Sim::PINCRead);
+
+///////////////////////////////////////////////////////////////////////////////
+/// Arduino core time and interrupt functions
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long millis(void)
+{
+	return (uint32_t)(Sim::Now()/1000);
+}
+
+unsigned long micros(void)
+{
+	return (uint32_t)Sim::Now();
+}
+
+void delay(unsigned long ms)
+{
+	Sim::Advance((uint64_t)ms*1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	Sim::Advance(us);
+}
+
+void cli(void)
+{
+	SREG.value&=~_BV(SREG_I);
+}
+
+void sei(void)
+{
+	SREG.value|=_BV(SREG_I);
+	Sim::ServiceInterrupts();
+}
+
+void sleep_cpu(void)
+{
+	Sim::Sleep();
+}
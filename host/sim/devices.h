@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+/// DEVICES.H
+///
+/// Models of the IIC devices on the ENDG3051 board, for the simulated bus:
+/// the 24LC512 EEPROM and the MCP7940 real time clock. Attach them with
+/// Sim::IICAttach.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _DEVICES_H_
+#define _DEVICES_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+namespace Sim {
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// EEPROM24LC512
+	///
+	/// 64 KB serial EEPROM. A write sets the 16-bit address pointer from its
+	/// first two bytes; any further bytes go into the page latch, wrapping
+	/// within the 128-byte page. The STOP starts the write cycle, during which
+	/// the device does not acknowledge its address. Reads are sequential from
+	/// the pointer, wrapping at the end of the array. Erased cells read 0xff.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	#define E24LC512_SIZE			65536UL
+	#define E24LC512_PAGE			128
+	#define E24LC512_WRITE_US		5000		// write cycle, tWC
+
+	class EEPROM24LC512 : public IICDevice {
+
+		public:
+
+			uint8_t			mem[E24LC512_SIZE];
+
+			unsigned long	pageWrites;				// write cycles started
+			unsigned long	busyNacks;				// addressed while busy
+
+			EEPROM24LC512(uint8_t addr=0xA0, uint32_t writeUs=E24LC512_WRITE_US);
+
+			virtual bool Start(bool read);
+			virtual bool Write(uint8_t data);
+			virtual uint8_t Read(bool ack);
+			virtual void Stop(void);
+
+			/// true during the write cycle
+			bool Busy(void);
+
+		private:
+
+			uint32_t		writeUs;
+			uint64_t		busyUntil;
+			uint16_t		pointer;
+			uint8_t			addrBytes;				// address bytes of this write
+			bool			writing;				// addressed for write
+			uint8_t			latch[E24LC512_PAGE];
+			bool			latched[E24LC512_PAGE];
+			bool			dirty;
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// MCP7940
+	///
+	/// Real time clock. The timekeeping registers (0x00-0x06) are BCD and run
+	/// from virtual time while the ST bit is set, with 12 and 24 hour modes,
+	/// month lengths and leap years. OSCRUN follows ST; PWRFAIL can only be
+	/// cleared; VBATEN is kept. A write sets the register pointer from its
+	/// first byte. The pointer wraps within the clock and control registers
+	/// (0x00-0x1f) and within the SRAM (0x20-0x5f).
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	#define MCP7940_REGS			0x60
+	#define MCP7940_SRAM			0x20
+
+	class MCP7940 : public IICDevice {
+
+		public:
+
+			MCP7940(uint8_t addr=0xDE);
+
+			virtual bool Start(bool read);
+			virtual bool Write(uint8_t data);
+			virtual uint8_t Read(bool ack);
+
+			/// register contents, with the clock brought up to date
+			uint8_t Register(uint8_t reg);
+
+		private:
+
+			uint8_t			regs[MCP7940_REGS];
+			uint8_t			pointer;
+			bool			first;					// next write is the pointer
+			uint64_t		lastTick;				// virtual time of the last second
+
+			void Update(void);
+			void Tick(void);
+			void Next(void);
+	};
+}
+
+#endif
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+/// EEPROM.CPP
+///
+/// 24LC512 serial EEPROM model
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "devices.h"
+
+namespace Sim {
+
+	EEPROM24LC512::EEPROM24LC512(uint8_t addr, uint32_t writeUs) :
+		IICDevice(addr), pageWrites(0), busyNacks(0), writeUs(writeUs), busyUntil(0),
+		pointer(0), addrBytes(0), writing(false), dirty(false)
+	{
+		memset(mem,0xff,sizeof(mem));
+		memset(latched,0,sizeof(latched));
+	}
+
+	bool EEPROM24LC512::Busy(void)
+	{
+		return Now()<busyUntil;
+	}
+
+	bool EEPROM24LC512::Start(bool read)
+	{
+		if(Busy()) {
+			busyNacks++;
+			return false;				// write cycle in progress
+		}
+		writing=!read;
+		addrBytes=0;
+		return true;
+	}
+
+	bool EEPROM24LC512::Write(uint8_t data)
+	{
+		if(addrBytes<2) {
+			pointer=(addrBytes==0)?(data<<8):(pointer | data);
+			addrBytes++;
+		} else {
+			// the page latch: the low bits of the pointer wrap within the page
+
+			uint8_t offset=pointer & (E24LC512_PAGE-1);
+			latch[offset]=data;
+			latched[offset]=true;
+			dirty=true;
+			pointer=(pointer & ~(E24LC512_PAGE-1)) | ((offset+1) & (E24LC512_PAGE-1));
+		}
+		return true;
+	}
+
+	uint8_t EEPROM24LC512::Read(bool /*ack*/)
+	{
+		return mem[pointer++];
+	}
+
+	void EEPROM24LC512::Stop(void)
+	{
+		if(dirty) {
+			uint16_t page=pointer & ~(E24LC512_PAGE-1);
+			for(int idx=0;idx<E24LC512_PAGE;idx++) {
+				if(latched[idx]) {
+					mem[page+idx]=latch[idx];
+					latched[idx]=false;
+				}
+			}
+			dirty=false;
+			busyUntil=Now()+writeUs;
+			pageWrites++;
+		}
+		writing=false;
+	}
+}
@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////////////////////////////////
+/// RTC.CPP
+///
+/// MCP7940 real time clock model
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "devices.h"
+
+// timekeeping registers
+
+#define RTCSEC			0x00
+#define RTCMIN			0x01
+#define RTCHOUR			0x02
+#define RTCWKDAY		0x03
+#define RTCDATE			0x04
+#define RTCMTH			0x05
+#define RTCYEAR			0x06
+
+#define RTC_ST			0x80		// RTCSEC: start oscillator
+#define RTC_12H			0x40		// RTCHOUR: 12 hour mode
+#define RTC_PM			0x20		// RTCHOUR: PM, in 12 hour mode
+#define RTC_OSCRUN		0x20		// RTCWKDAY: oscillator running
+#define RTC_PWRFAIL		0x10		// RTCWKDAY: power failed
+#define RTC_VBATEN		0x08		// RTCWKDAY: battery backup enabled
+#define RTC_LPYR		0x20		// RTCMTH: leap year
+
+// writable bits of the timekeeping registers; the rest read as zero, or are
+// kept by the model
+
+static const uint8_t writable[RTCYEAR+1]={ 0xff, 0x7f, 0x7f, 0x0f, 0x3f, 0x1f, 0xff };
+
+static uint8_t FromBCD(uint8_t bcd)
+{
+	return (bcd>>4)*10+(bcd & 0x0f);
+}
+
+static uint8_t ToBCD(uint8_t bin)
+{
+	return ((bin/10)<<4) | (bin%10);
+}
+
+namespace Sim {
+
+	MCP7940::MCP7940(uint8_t addr) : IICDevice(addr), pointer(0), first(false), lastTick(0)
+	{
+		memset(regs,0,sizeof(regs));
+		regs[RTCWKDAY]=1;
+		regs[RTCDATE]=0x01;
+		regs[RTCMTH]=0x01;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Update
+	///
+	/// Bring the clock up to virtual time. While stopped, the second boundary
+	/// moves with the time so that starting the clock starts a fresh second.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void MCP7940::Update(void)
+	{
+		if(!(regs[RTCSEC] & RTC_ST)) {
+			lastTick=Now();
+			return;
+		}
+		while(Now()-lastTick>=1000000ULL) {
+			lastTick+=1000000ULL;
+			Tick();
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Tick
+	///
+	/// One second, with the carries
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void MCP7940::Tick(void)
+	{
+		static const uint8_t monthDays[12]={ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		uint8_t sec=FromBCD(regs[RTCSEC] & 0x7f)+1;
+
+		regs[RTCSEC]=(regs[RTCSEC] & RTC_ST) | ToBCD(sec%60);
+		if(sec<60) {
+			return;
+		}
+
+		uint8_t min=FromBCD(regs[RTCMIN] & 0x7f)+1;
+		regs[RTCMIN]=ToBCD(min%60);
+		if(min<60) {
+			return;
+		}
+
+		uint8_t hour=regs[RTCHOUR];
+		bool newDay;
+		if(hour & RTC_12H) {
+			uint8_t h=FromBCD(hour & 0x1f);
+			bool pm=hour & RTC_PM;
+			if(h==11) {
+				pm=!pm;
+				newDay=!pm;				// 11 PM to 12 AM
+			} else {
+				newDay=false;
+			}
+			h=(h==12)?1:h+1;
+			regs[RTCHOUR]=RTC_12H | ((pm)?RTC_PM:0) | ToBCD(h);
+		} else {
+			uint8_t h=FromBCD(hour & 0x3f)+1;
+			newDay=(h==24);
+			regs[RTCHOUR]=ToBCD(h%24);
+		}
+		if(!newDay) {
+			return;
+		}
+
+		uint8_t wkday=(regs[RTCWKDAY] & 0x07)%7+1;
+		regs[RTCWKDAY]=(regs[RTCWKDAY] & ~0x07) | wkday;
+
+		uint8_t year=FromBCD(regs[RTCYEAR]);
+		uint8_t month=FromBCD(regs[RTCMTH] & 0x1f);
+		uint8_t date=FromBCD(regs[RTCDATE] & 0x3f)+1;
+		uint8_t days=((month>=1) && (month<=12))?monthDays[month-1]:31;
+		if((month==2) && !(year%4)) {
+			days=29;
+		}
+		if(date>days) {
+			date=1;
+			if(++month>12) {
+				month=1;
+				year=(year+1)%100;
+			}
+		}
+		regs[RTCDATE]=ToBCD(date);
+		regs[RTCYEAR]=ToBCD(year);
+		regs[RTCMTH]=ToBCD(month) | ((year%4)?0:RTC_LPYR);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Next
+	///
+	/// Advance the register pointer, wrapping within its block
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void MCP7940::Next(void)
+	{
+		if(pointer<MCP7940_SRAM) {
+			pointer=(pointer+1) & (MCP7940_SRAM-1);
+		} else {
+			pointer=(pointer+1<MCP7940_REGS)?pointer+1:MCP7940_SRAM;
+		}
+	}
+
+	uint8_t MCP7940::Register(uint8_t reg)
+	{
+		Update();
+		if(reg==RTCWKDAY) {
+			return (regs[reg] & ~RTC_OSCRUN) | ((regs[RTCSEC] & RTC_ST)?RTC_OSCRUN:0);
+		}
+		return (reg<MCP7940_REGS)?regs[reg]:0;
+	}
+
+	bool MCP7940::Start(bool read)
+	{
+		first=!read;
+		Update();
+		return true;
+	}
+
+	bool MCP7940::Write(uint8_t data)
+	{
+		if(first) {
+			pointer=(data<MCP7940_REGS)?data:0;
+			first=false;
+			return true;
+		}
+		Update();
+		if(pointer<=RTCYEAR) {
+			uint8_t keep=regs[pointer] & ~writable[pointer];
+			if(pointer==RTCWKDAY) {
+				// PWRFAIL can be cleared, not set
+				keep&=~RTC_PWRFAIL;
+				keep|=regs[pointer] & data & RTC_PWRFAIL;
+			} else if(pointer==RTCMTH) {
+				keep&=RTC_LPYR;
+			} else {
+				keep=0;
+			}
+			regs[pointer]=keep | (data & writable[pointer]);
+			if(pointer==RTCSEC) {
+				lastTick=Now();			// writing the seconds restarts the second
+			}
+		} else {
+			regs[pointer]=data;
+		}
+		Next();
+		return true;
+	}
+
+	uint8_t MCP7940::Read(bool /*ack*/)
+	{
+		uint8_t value=Register(pointer);
+		Next();
+		return value;
+	}
+}
@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+/// SERIAL.CPP
+///
+/// Simulated serial port. Characters go straight to stdout, but once begin()
+/// has set a baud rate they leave the port at that rate in virtual time: ten
+/// bit times a character (8N1), through a transmit buffer of
+/// SERIAL_TX_BUFFER_SIZE-1 characters as in the Arduino core. Writing to a
+/// full buffer waits, moving virtual time on, until a character has gone.
+/// Before begin() the port is infinitely fast.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include <math.h>
+#include "sim.h"
+
+HardwareSerial Serial;
+
+namespace Sim {
+
+	static bool serialEcho=true;
+	static FILE * serialOut=NULL;		// stdout
+	static double charUs=0;				// time to send a character, 0 for no timing
+	static double txEnd=0;				// virtual time the last queued character is sent
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// SerialEcho
+	///
+	/// Enable or disable echo of the serial port to stdout
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void SerialEcho(bool echo)
+	{
+		serialEcho=echo;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// SerialCapture
+	///
+	/// Send the serial port to a file instead of stdout; NULL for stdout again
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void SerialCapture(FILE * fp)
+	{
+		fflush((serialOut)?serialOut:stdout);
+		serialOut=fp;
+	}
+
+	// characters waiting to be sent: all but the one in the shift register
+
+	static int Queued(void)
+	{
+		double left=txEnd-(double)Now();
+		return (left>charUs)?(int)ceil(left/charUs)-1:0;
+	}
+
+	static size_t Out(const char * str, size_t len)
+	{
+		if(charUs>0) {
+			for(size_t idx=0;idx<len;idx++) {
+				while(Queued()>=SERIAL_TX_BUFFER_SIZE-1) {
+					Advance((uint64_t)ceil(txEnd-(SERIAL_TX_BUFFER_SIZE-1)*charUs-(double)Now()));
+				}
+				txEnd=fmax(txEnd,(double)Now())+charUs;
+			}
+		}
+		if(serialEcho) {
+			fwrite(str,1,len,(serialOut)?serialOut:stdout);
+		}
+		return len;
+	}
+
+	static size_t OutNumber(unsigned long n, bool neg, int base)
+	{
+		char buf[34];
+		const char * fmt=(base==HEX)?"%s%lx":"%s%lu";
+		int len=snprintf(buf,sizeof(buf),fmt,(neg)?"-":"",n);
+		return Out(buf,len);
+	}
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+	Sim::charUs=(baud)?10e6/baud:0;
+	Sim::txEnd=0;
+}
+
+void HardwareSerial::flush(void)
+{
+	if(Sim::txEnd>(double)Sim::Now()) {
+		Sim::Advance((uint64_t)ceil(Sim::txEnd-(double)Sim::Now()));
+	}
+	fflush((Sim::serialOut)?Sim::serialOut:stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return Sim::Out((const char *)&c,1);
+}
+
+size_t HardwareSerial::write(const char * str)
+{
+	return Sim::Out(str,strlen(str));
+}
+
+size_t HardwareSerial::write(const uint8_t * buf, size_t size)
+{
+	return Sim::Out((const char *)buf,size);
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+	return (Sim::charUs>0)?SERIAL_TX_BUFFER_SIZE-1-Sim::Queued():SERIAL_TX_BUFFER_SIZE-1;
+}
+
+size_t HardwareSerial::print(const char * str)
+{
+	return write(str);
+}
+
+size_t HardwareSerial::print(char c)
+{
+	return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(int n, int base)
+{
+	return print((long)n,base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base)
+{
+	return print((unsigned long)n,base);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+	if((n<0) && (base==DEC)) {
+		return Sim::OutNumber(-(unsigned long)n,true,base);
+	}
+	return Sim::OutNumber((unsigned long)n,false,base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+	return Sim::OutNumber(n,false,base);
+}
+
+size_t HardwareSerial::print(double n, int digits)
+{
+	char buf[40];
+	int len=snprintf(buf,sizeof(buf),"%.*f",digits,n);
+	return Sim::Out(buf,len);
+}
+
+size_t HardwareSerial::println(void)
+{
+	return write("\r\n");
+}
+
+size_t HardwareSerial::println(const char * str)
+{
+	size_t n=print(str);
+	return n+println();
+}
+
+size_t HardwareSerial::println(char c)
+{
+	size_t n=print(c);
+	return n+println();
+}
+
+size_t HardwareSerial::println(int n, int base)
+{
+	size_t r=print(n,base);
+	return r+println();
+}
+
+size_t HardwareSerial::println(unsigned int n, int base)
+{
+	size_t r=print(n,base);
+	return r+println();
+}
+
+size_t HardwareSerial::println(long n, int base)
+{
+	size_t r=print(n,base);
+	return r+println();
+}
+
+size_t HardwareSerial::println(unsigned long n, int base)
+{
+	size_t r=print(n,base);
+	return r+println();
+}
+
+size_t HardwareSerial::println(double n, int digits)
+{
+	size_t r=print(n,digits);
+	return r+println();
+}
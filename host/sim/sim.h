@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+/// SIM.H
+///
+/// Host simulator control interface. This is only visible to the host driver
+/// and to simulated device models - the kernel and application never include
+/// it, they see the simulated machine through Arduino.h only.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace Sim {
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Now
+	///
+	/// Current virtual time in microseconds since reset
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t Now(void);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Advance
+	///
+	/// Move virtual time forward by the given number of microseconds, servicing
+	/// any interrupt that becomes pending on the way.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Advance(uint64_t us);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Sleep
+	///
+	/// Sleep the CPU until the next event that would wake it, moving virtual
+	/// time forward. This is what sleep_cpu() does on the host.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Sleep(void);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Slept
+	///
+	/// Total virtual time the CPU has spent asleep, in microseconds
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t Slept(void);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// ServiceInterrupts
+	///
+	/// Deliver pending interrupts if the global interrupt flag is set. Called
+	/// at every point where real hardware could take an interrupt that matters
+	/// to us.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void ServiceInterrupts(void);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// SerialEcho
+	///
+	/// Enable or disable echo of the serial port to stdout
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void SerialEcho(bool echo);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// SerialCapture
+	///
+	/// Send the serial port to a file instead of stdout; NULL for stdout again
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void SerialCapture(FILE * fp);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// GPIOTrace
+	///
+	/// Enable or disable logging of output port writes to stderr
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void GPIOTrace(bool trace);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICDevice
+	///
+	/// Base class for a slave on the simulated IIC bus. Override the handlers to
+	/// model a device. Addresses are 8-bit (R/W bit clear), as used by the
+	/// kernel IIC driver.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	class IICDevice {
+
+		public:
+
+			uint8_t		address;
+			IICDevice *	pNext;
+
+			IICDevice(uint8_t addr) : address(addr & 0xfe), pNext(0) {};
+			virtual ~IICDevice() {};
+
+			/// addressed after a START. Return true to ACK
+			virtual bool Start(bool /*read*/) { return true; };
+
+			/// master has sent a byte. Return true to ACK
+			virtual bool Write(uint8_t /*data*/) { return true; };
+
+			/// master wants a byte. ack is false on the last byte of a read
+			virtual uint8_t Read(bool /*ack*/) { return 0xff; };
+
+			/// STOP, or a repeated START addressed elsewhere
+			virtual void Stop(void) {};
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICAttach
+	///
+	/// Attach a device model to the simulated bus. The device is owned by the
+	/// caller.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICAttach(IICDevice * dev);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICTiming
+	///
+	/// Enable (the default) or disable bus timing. Without it every bus action
+	/// completes the moment it is started.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICTiming(bool enable);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICBusy
+	///
+	/// Total virtual time the bus has spent busy, in microseconds
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t IICBusy(void);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICHoldSCL
+	///
+	/// Fault injection: a slave holds SCL low, indefinitely, until released. The
+	/// TWI stalls and no amount of clocking frees the bus.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICHoldSCL(bool hold);
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICHoldSDA
+	///
+	/// Fault injection: a slave holds SDA low, as one does when reset part way
+	/// through sending a byte, until SCL has been clocked the given number of
+	/// times. The TWI stalls meanwhile.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICHoldSDA(uint8_t clocks);
+}
+
+#endif
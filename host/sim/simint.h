@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////////////
+/// SIMINT.H
+///
+/// Simulator internals shared between the simulated peripherals
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SIMINT_H_
+#define _SIMINT_H_
+
+#include <stdint.h>
+
+// interrupt vectors, implemented by the firmware with ISR(). Weak so that an
+// image without a handler still links.
+
+extern "C" void TWI_vect(void) __attribute__((weak));
+
+namespace Sim {
+
+	// TWI interrupt line: TWINT set while TWIE is enabled
+
+	bool TWIInterruptPending(void);
+
+	// bus action timing: when the action on the wire completes (UINT64_MAX if
+	// there is none), and completing it
+
+	uint64_t TWINextEvent(void);
+	void TWIEvent(void);
+
+	// IIC bus lines held low by a slave, as PORTC bits
+
+	uint8_t IICLinesLow(void);
+
+	// DDRC is changing: the firmware is driving the IIC lines by hand
+
+	void IICDirection(uint8_t from, uint8_t to);
+}
+
+#endif
@@ -0,0 +1,325 @@
+///////////////////////////////////////////////////////////////////////////////
+/// TWI.CPP
+///
+/// Simulated ATMega328p TWI peripheral (master mode) and IIC bus. Writes to
+/// TWCR with TWINT set perform the requested bus action against the attached
+/// device models and post the resulting status code in TWSR, exactly as the
+/// data sheet describes for the master transmitter and receiver modes.
+///
+/// Bus actions take as long as they would on the wire: a START or STOP one
+/// SCL period, a byte and its ACK nine, at the clock TWBR and the TWSR
+/// prescaler give. The action completes, and TWINT is set, when virtual time
+/// reaches the end of it.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include <Arduino.h>
+#include "sim.h"
+#include "simint.h"
+
+namespace Sim {
+
+	// TWI status codes (TWSR & 0xf8)
+
+	#define TW_START			0x08
+	#define TW_REP_START		0x10
+	#define TW_MT_SLA_ACK		0x18
+	#define TW_MT_SLA_NACK		0x20
+	#define TW_MT_DATA_ACK		0x28
+	#define TW_MT_DATA_NACK		0x30
+	#define TW_MR_SLA_ACK		0x40
+	#define TW_MR_SLA_NACK		0x48
+	#define TW_MR_DATA_ACK		0x50
+	#define TW_MR_DATA_NACK		0x58
+	#define TW_NO_INFO			0xf8
+
+	enum TWISTATE {
+		TWI_IDLE,				// bus free
+		TWI_STARTED,			// START sent, next byte is SLA+R/W
+		TWI_MT,					// master transmitter
+		TWI_MR,					// master receiver
+		TWI_NOSLAVE				// SLA not acknowledged, waiting for STOP/START
+	};
+
+	static IICDevice *	devices=NULL;
+	static IICDevice *	selected=NULL;
+	static TWISTATE		state=TWI_IDLE;
+	static uint8_t		status=TW_NO_INFO;
+
+	static bool			sclHeld=false;		// injected faults
+	static uint8_t		sdaClocks=0;		// SCL clocks until SDA is let go
+
+	static bool			timing=true;		// false: actions complete at once
+	static bool			pending=false;		// an action is on the wire
+	static uint8_t		pendingCtl;			// its TWCR command
+	static uint64_t		due;				// when it completes
+	static uint64_t		busyTime=0;			// total time on the wire, us
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICAttach
+	///
+	/// Attach a device model to the simulated bus
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICAttach(IICDevice * dev)
+	{
+		dev->pNext=devices;
+		devices=dev;
+	}
+
+	static IICDevice * FindDevice(uint8_t addr)
+	{
+		IICDevice * dev=devices;
+		while(dev && (dev->address!=(addr & 0xfe))) {
+			dev=dev->pNext;
+		}
+		return dev;
+	}
+
+	static void ReleaseSlave(void)
+	{
+		if(selected) {
+			selected->Stop();
+			selected=NULL;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICTiming
+	///
+	/// Enable or disable bus timing
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICTiming(bool enable)
+	{
+		timing=enable;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICBusy
+	///
+	/// Total time the bus has been busy
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t IICBusy(void)
+	{
+		return busyTime;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICHoldSCL, IICHoldSDA
+	///
+	/// Fault injection
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICHoldSCL(bool hold)
+	{
+		sclHeld=hold;
+	}
+
+	void IICHoldSDA(uint8_t clocks)
+	{
+		sdaClocks=clocks;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICLinesLow
+	///
+	/// Lines held low by a slave, as PORTC bits
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint8_t IICLinesLow(void)
+	{
+		return ((sclHeld)?_BV(PC5):0) | ((sdaClocks)?_BV(PC4):0);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICDirection
+	///
+	/// The firmware is clocking SCL by hand: each release (a rising edge, unless
+	/// the slave is holding it) clocks a bit out of a slave holding SDA.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICDirection(uint8_t from, uint8_t to)
+	{
+		if((from & _BV(PC5)) && !(to & _BV(PC5)) && !sclHeld && sdaClocks) {
+			sdaClocks--;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// TWIAction
+	///
+	/// Perform the bus action requested by a TWCR write with TWINT set
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	static void TWIAction(uint8_t ctl)
+	{
+		if(ctl & _BV(TWSTA)) {
+			ReleaseSlave();
+			if(ctl & _BV(TWSTO)) {
+				state=TWI_IDLE;				// STOP, then START
+			}
+			status=(state==TWI_IDLE)?TW_START:TW_REP_START;
+			state=TWI_STARTED;
+		} else if(ctl & _BV(TWSTO)) {
+			ReleaseSlave();
+			status=TW_NO_INFO;
+			state=TWI_IDLE;
+			return;							// TWINT is not set after a STOP
+		} else {
+			switch(state) {
+				case TWI_STARTED: {
+					bool read=TWDR.value & 0x01;
+					selected=FindDevice(TWDR.value);
+					if(selected && selected->Start(read)) {
+						status=(read)?TW_MR_SLA_ACK:TW_MT_SLA_ACK;
+						state=(read)?TWI_MR:TWI_MT;
+					} else {
+						selected=NULL;
+						status=(read)?TW_MR_SLA_NACK:TW_MT_SLA_NACK;
+						state=TWI_NOSLAVE;
+					}
+					break;
+				}
+				case TWI_MT:
+					status=(selected->Write(TWDR.value))?TW_MT_DATA_ACK:TW_MT_DATA_NACK;
+					break;
+				case TWI_MR: {
+					bool ack=ctl & _BV(TWEA);
+					TWDR.value=selected->Read(ack);
+					status=(ack)?TW_MR_DATA_ACK:TW_MR_DATA_NACK;
+					break;
+				}
+				default:
+					status=TW_NO_INFO;
+					break;
+			}
+		}
+		TWCR.value|=_BV(TWINT);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// ActionTime
+	///
+	/// Time on the wire for a bus action, in microseconds (at least one)
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	static uint64_t ActionTime(uint8_t ctl)
+	{
+		unsigned bits;
+		uint64_t cycles;
+
+		if(ctl & _BV(TWSTA)) {
+			bits=(ctl & _BV(TWSTO))?2:1;
+		} else if(ctl & _BV(TWSTO)) {
+			bits=1;
+		} else {
+			bits=9;
+		}
+		cycles=(uint64_t)bits*(16+2UL*TWBR.value*(1<<(2*(TWSR.value & 0x03))));
+		return (cycles*1000000ULL+F_CPU-1)/F_CPU;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// TWINextEvent
+	///
+	/// When the action on the wire completes, if there is one
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	uint64_t TWINextEvent(void)
+	{
+		return (pending)?due:UINT64_MAX;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// TWIEvent
+	///
+	/// Complete the action on the wire. TWSTO clears when the STOP has gone.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void TWIEvent(void)
+	{
+		if(pending) {
+			pending=false;
+			TWCR.value&=~_BV(TWSTO);
+			TWIAction(pendingCtl);
+		}
+	}
+
+	//
+	// register hooks
+
+	static void TWCRWrite(SimReg& reg, uint8_t value)
+	{
+		// TWINT is cleared by writing one to it, and writing zero leaves it
+		// (and SCL held low) as it was; TWSTO stays set until the STOP has been
+		// sent
+
+		reg.value=(value & ~(_BV(TWINT) | _BV(TWSTO))) | ((value & _BV(TWINT)) ? 0 : (reg.value & _BV(TWINT)));
+		if(!(value & _BV(TWEN))) {
+			// switched off: the TWI lets go of the bus and forgets it
+			reg.value&=~_BV(TWINT);
+			ReleaseSlave();
+			status=TW_NO_INFO;
+			state=TWI_IDLE;
+			pending=false;
+		} else if(value & _BV(TWINT)) {
+			if(IICLinesLow()) {
+				// a slave is holding the bus: the action never completes
+				reg.value|=value & _BV(TWSTO);
+				pending=false;
+			} else if(timing) {
+				uint64_t time=ActionTime(value);
+				reg.value|=value & _BV(TWSTO);
+				pendingCtl=value;
+				due=Now()+time;
+				busyTime+=time;
+				pending=true;
+			} else {
+				TWIAction(value);
+			}
+		}
+		ServiceInterrupts();
+	}
+
+	static uint8_t TWSRRead(SimReg& reg)
+	{
+		return status | (reg.value & (_BV(TWPS1) | _BV(TWPS0)));
+	}
+
+	static void TWSRWrite(SimReg& reg, uint8_t value)
+	{
+		reg.value=value & (_BV(TWPS1) | _BV(TWPS0));	// only the prescaler bits are writable
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// TWIInterruptPending
+	///
+	/// TWI interrupt line
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	bool TWIInterruptPending(void)
+	{
+		return (TWCR.value & _BV(TWINT)) && (TWCR.value & _BV(TWIE)) && (TWCR.value & _BV(TWEN));
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Registers
+///////////////////////////////////////////////////////////////////////////////
+
+SimReg TWBR, TWDR, TWAR(0xfe), TWAMR;
+SimReg TWCR(0,NULL,Sim::TWCRWrite);
+SimReg TWSR(0,Sim::TWSRRead,Sim::TWSRWrite);
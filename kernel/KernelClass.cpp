@@ -8,6 +8,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "KernelClass.h"
+#include <string.h>
 
 namespace Kernel {
 
@@ -20,8 +21,10 @@ namespace Kernel {
 ///
 ///////////////////////////////////////////////////////////////////////////////
 
-KernelClass::KernelClass()
+KernelClass::KernelClass() : passBudget(KERNEL_PASS_BUDGET_US), idleSleep(KERNEL_IDLE_SLEEP)
 {
+	ResetStats();
+	stats.msgShare=(KERNEL_MSG_SHARE_MIN+KERNEL_MSG_SHARE_MAX)/2;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -39,4 +42,19 @@ KernelClass::~KernelClass()
 	// normally never called in an embedded environment
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// ResetStats
+///
+/// Zero the counters and high-water marks. The adapted message share is
+/// kept.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+void KernelClass::ResetStats(void)
+{
+	uint8_t share=stats.msgShare;
+	memset(&stats,0,sizeof(stats));
+	stats.msgShare=share;
+}
+
 }
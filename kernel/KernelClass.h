@@ -13,13 +13,64 @@
 #include "taskring.h"
 #include "mq.h"
 #include "iic.h"
+#include "timers.h"
+
+// Default time budget for one pass of the kernel loop, in microseconds. Each
+// pass spends up to its message share of this dispatching messages, then runs
+// tasks with the rest.
+
+#ifndef KERNEL_PASS_BUDGET_US
+#define KERNEL_PASS_BUDGET_US		500
+#endif
+
+// Limits of the message share of the budget, in 256ths. The share grows while
+// messages are left waiting at the end of the message phase and decays back
+// when the queue empties with time to spare. The upper limit keeps a burst of
+// messages from starving the tasks.
+
+#ifndef KERNEL_MSG_SHARE_MIN
+#define KERNEL_MSG_SHARE_MIN		64
+#endif
+
+#ifndef KERNEL_MSG_SHARE_MAX
+#define KERNEL_MSG_SHARE_MAX		224
+#endif
+
+// Sleep the CPU (AVR idle mode) when no message is waiting and every task is
+// sleeping or suspended. Define as 0 to start with the loop spinning instead;
+// it can be changed at runtime with SetIdleSleep.
+
+#ifndef KERNEL_IDLE_SLEEP
+#define KERNEL_IDLE_SLEEP			1
+#endif
 
 namespace Kernel {
 
+	//
+	// Kernel loop statistics, accumulated since the last ResetStats
+
+	typedef struct KERNELSTATS {
+		uint32_t	passes;				// loop() passes
+		uint32_t	messages;			// messages dispatched
+		uint32_t	timers;				// timers fired
+		uint32_t	tasks;				// task ring steps
+		uint16_t	overruns;			// passes that took longer than the budget
+		uint16_t	maxPassUs;			// longest pass
+		uint32_t	sleeps;				// times the CPU was put to sleep
+		uint8_t		maxPending;			// deepest queue seen at the start of a pass
+		uint8_t		msgShare;			// current message share of the budget, 256ths
+	};
+
 	class KernelClass {
 
 		private:
 
+			friend void ::loop();		// the kernel loop maintains the budget and stats
+
+			uint16_t		passBudget;
+			bool			idleSleep;
+			KERNELSTATS		stats;
+
 		public:
 
 			/// Accessible members
@@ -27,6 +78,7 @@ namespace Kernel {
 			TaskRing&	TaskManager=TaskRing::Get();
 			MQClass&	MessageQueue=MQClass::Get();
             IIC&        IICDriver=IIC::Get();
+			TimerService&	Timers=TimerService::Get();
 
 			////////////////////////////////////////////////////////////////////////////////
 			/// KernelClass
@@ -50,6 +102,78 @@ namespace Kernel {
 			///////////////////////////////////////////////////////////////////////////////
 
 			~KernelClass();
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// SetPassBudget
+			///
+			/// Set the time budget for one pass of the kernel loop. A larger budget
+			/// favours throughput, a smaller one the latency of task handlers. Every
+			/// pass dispatches at least one message if any are waiting and runs at least
+			/// one task, so a pass may overrun a very small budget.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: us - budget in microseconds
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void SetPassBudget(uint16_t us) { passBudget=us; };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// GetPassBudget
+			///
+			/// @scope: PUBLIC
+			/// @context: ANY
+			/// @param: none
+			/// @return: time budget for one pass of the kernel loop, in microseconds
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			uint16_t GetPassBudget(void) const { return passBudget; };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// SetIdleSleep
+			///
+			/// Enable or disable sleeping the CPU when there is nothing to do. With it
+			/// disabled the loop spins, e.g. while it is being measured with the timer
+			/// interrupt that would wake it turned off.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: sleep - true to sleep when idle
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void SetIdleSleep(bool sleep) { idleSleep=sleep; };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Stats
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: none
+			/// @return: kernel loop statistics
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			const KERNELSTATS& Stats(void) const { return stats; };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// ResetStats
+			///
+			/// Zero the counters and high-water marks. The adapted message share is
+			/// kept.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: none
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void ResetStats(void);
 	};
 
 }
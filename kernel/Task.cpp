@@ -48,4 +48,72 @@ namespace Kernel {
 		Kernel::OS.TaskManager.RegisterTaskHandler(this);
 	}
 
+	///////////////////////////////////////////////////////////////////////////////
+	/// Suspend
+	///
+	/// Take the task off the task ring until it is resumed.
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: NONE
+	/// @return: NONE
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Task::Suspend(void)
+	{
+		Kernel::OS.TaskManager.Suspend(this);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Resume
+	///
+	/// Put a suspended or sleeping task back on the task ring.
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: NONE
+	/// @return: NONE
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void Task::Resume(void)
+	{
+		Kernel::OS.TaskManager.Resume(this);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// WakeAt
+	///
+	/// Take the task off the task ring until millis() reaches the given time
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: ms - millis() time to wake at
+	/// @return: zero for success, -1 on failure
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int Task::WakeAt(unsigned long ms)
+	{
+		return Kernel::OS.TaskManager.Sleep(this,ms);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// WakeAfter
+	///
+	/// Take the task off the task ring for the given time
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: ms - milliseconds from now to wake
+	/// @return: zero for success, -1 on failure
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int Task::WakeAfter(unsigned long ms)
+	{
+		return Kernel::OS.TaskManager.Sleep(this,millis()+ms);
+	}
+
 };
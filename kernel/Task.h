@@ -9,14 +9,44 @@
 #ifndef TASK_H_
 #define TASK_H_
 
+#include <stdint.h>
+#include <stddef.h>
 #include "EventReceiver.h"
 
 namespace Kernel {
 
 	class Task : public EventReceiver {
 
+		private:
+
+			friend class TaskRing;		// the task ring owns the links
+			friend class TASKINTERNALS;
+
+			// intrusive task ring links, so that registering, deregistering,
+			// suspending and resuming need no allocation and no search
+
+			Task *			pTaskNext;
+			Task *			pTaskPrev;
+			uint8_t			taskState;		// TASKSTATE
+
+			// while sleeping, the millis() time to wake and the task's place in
+			// the task ring's deadline heap
+
+			unsigned long	wakeTime;
+			uint8_t			heapIndex;
+
 		public:
 
+			//
+			// task states
+
+			typedef enum TASKSTATE {
+				TASK_STATE_STOPPED,		// not registered with the task ring
+				TASK_STATE_RUNNING,		// on the ring, TaskLoop called every pass
+				TASK_STATE_SUSPENDED,	// registered, but off the ring
+				TASK_STATE_SLEEPING		// off the ring until its wake time
+			};
+
 			///////////////////////////////////////////////////////////////////////////////
 			/// Task
 			///
@@ -30,7 +60,7 @@ namespace Kernel {
 			///
 			///////////////////////////////////////////////////////////////////////////////
 
-			Task() {};
+			Task() : pTaskNext(NULL), pTaskPrev(NULL), taskState(TASK_STATE_STOPPED), wakeTime(0), heapIndex(0) {};
 
 			///////////////////////////////////////////////////////////////////////////////
 			/// ~Task
@@ -76,6 +106,83 @@ namespace Kernel {
 
 			void Start(void);
 
+			///////////////////////////////////////////////////////////////////////////////
+			/// Suspend
+			///
+			/// Take the task off the task ring. TaskLoop is not called, and the task
+			/// costs nothing per pass, until it is resumed. The task remains subscribed
+			/// to its messages, so an event handler may resume it. May be called from
+			/// the task's own TaskLoop.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: NONE
+			/// @return: NONE
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Suspend(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Resume
+			///
+			/// Put a suspended or sleeping task back on the task ring.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: NONE
+			/// @return: NONE
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Resume(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// State
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: NONE
+			/// @return: TASK_STATE_STOPPED, TASK_STATE_RUNNING, TASK_STATE_SUSPENDED or
+			///          TASK_STATE_SLEEPING
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			uint8_t State(void) const { return taskState; };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// WakeAt
+			///
+			/// Declare the next time the task needs to run. The task is taken off the
+			/// task ring and put back when millis() reaches the given time; until then
+			/// it costs nothing per pass, and when no task is due and no message is
+			/// waiting the kernel sleeps the CPU. Normally called at the end of
+			/// TaskLoop. Resume wakes the task early, e.g. from an event handler.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: ms - millis() time to wake at
+			/// @return: zero for success, -1 if the task is not running or too many
+			///          tasks are already sleeping (the task then stays on the ring)
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int WakeAt(unsigned long ms);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// WakeAfter
+			///
+			/// As WakeAt, with the wake time given relative to now
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: ms - milliseconds from now to wake
+			/// @return: zero for success, -1 as for WakeAt
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int WakeAfter(unsigned long ms);
+
 	};
 }
 
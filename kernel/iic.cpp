@@ -3,16 +3,219 @@
 ///
 /// IIC peripheral driver for ATMega328p
 ///
+/// Transactions are queued and run by a state machine in the TWI interrupt,
+/// following the master transmitter and receiver tables of the data sheet.
+/// The segments of a transaction are joined by repeated STARTs, or gathered
+/// into one write. A read may also be held part way, with SCL low, and
+/// resumed, to stream it through a small buffer.
+///
+/// Nothing waits on the bus without a deadline. A transaction still running
+/// when its timeout expires is abandoned and the bus recovered by hand, so a
+/// slave holding SDA or SCL low costs one transaction, not the kernel.
+///
 /// Dr J A Gow 2022
 ///
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <Arduino.h>
+#include <avr/sleep.h>
 #include "iic.h"
+#include "interrupts.h"
+#include <string.h>
+
+// TWI status codes (TWSR & 0xf8)
+
+#define TW_START            0x08
+#define TW_REP_START        0x10
+#define TW_MT_SLA_ACK       0x18
+#define TW_MT_SLA_NACK      0x20
+#define TW_MT_DATA_ACK      0x28
+#define TW_MT_DATA_NACK     0x30
+#define TW_MT_ARB_LOST      0x38
+#define TW_MR_SLA_ACK       0x40
+#define TW_MR_SLA_NACK      0x48
+#define TW_MR_DATA_ACK      0x50
+#define TW_MR_DATA_NACK     0x58
+#define TW_BUS_ERROR        0x00
+
+// TWCR commands. Each clears TWINT to start the next bus action.
+
+#define TWCR_NEXT           (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define TWCR_START          (TWCR_NEXT | _BV(TWSTA))
+#define TWCR_ACK            (TWCR_NEXT | _BV(TWEA))
+#define TWCR_STOP           (_BV(TWINT) | _BV(TWEN) | _BV(TWSTO))
+#define TWCR_STOP_START     (TWCR_NEXT | _BV(TWSTO) | _BV(TWSTA))
 
 namespace Kernel
 {
 
+    // TWI clock settings for each profile, fixed at compile time
+
+    typedef struct IICCLOCK {
+        uint8_t twbr;
+        uint8_t twps;
+    } IICCLOCK;
+
+    static const IICCLOCK IICClocks[IIC_SPEED_COUNT] = {
+        { IIC_TWBR(IIC_SCL_100K), IIC_TWPS(IIC_SCL_100K) },
+        { IIC_TWBR(IIC_SCL_400K), IIC_TWPS(IIC_SCL_400K) },
+        { IIC_TWBR(IIC_SCL_1M), IIC_TWPS(IIC_SCL_1M) }
+    };
+
+    // devices with settings of their own: a clock other than the default, or
+    // a write cycle after which they must be polled for ACK
+
+    typedef struct IICPROFILE {
+        uint8_t addr;               // 0 if free
+        uint8_t speed;              // IICSPEED
+        uint8_t writeMs;            // longest write cycle, 0 if none
+        uint8_t busy;               // written since last acknowledged
+    } IICPROFILE;
+
+    // driver state, shared with the TWI interrupt
+    //
+    // pHead is the transaction on the bus, followed by the rest of the queue.
+    // Completed transactions that want a callback or message wait on the done
+    // list for Loop.
+
+    class IICInternals {
+        public:
+            IICTransaction * volatile   pHead;
+            IICTransaction *            pTail;
+            IICTransaction * volatile   pDoneHead;
+            IICTransaction *            pDoneTail;
+            uint16_t                    idx;        // bytes done in this segment
+            uint16_t                    end;        // bytes to read into it before a hold or the end
+            uint8_t                     seg;        // segment on the bus
+            uint8_t                     more;       // hold the read at end, rather than end it
+            uint8_t                     held;       // the read on the bus is held
+            IICPROFILE *                pProfile;   // of the device on the bus, or NULL
+            unsigned long               started;    // micros() at its START
+            unsigned long               limit;      // its timeout, us
+            uint8_t                     speed;      // IICSPEED the TWI is set to
+            IICPROFILE                  profiles[IIC_MAX_PROFILES];
+            IICSTATS                    stats;
+#if IIC_TRACE
+            IICTRACE                    trace[IIC_TRACE_DEPTH];
+            uint8_t                     traced;     // entries recorded, mod 256
+            IICTRACESTATS               traceStats;
+#endif
+    };
+
+    static IICInternals IICBlock;
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Clock
+    ///
+    /// Set the bus clock. Only the prescaler bits of TWSR are writable.
+    ///
+    /// @scope: INTERNAL
+    /// @context: ANY, with the bus idle
+    /// @param: speed - clock profile
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Clock(uint8_t speed)
+    {
+        TWBR = IICClocks[speed].twbr;
+        TWSR = IICClocks[speed].twps;
+        IICBlock.speed = speed;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Init
+    ///
+    /// Set the default bus clock. Also used to put the TWI back after a bus
+    /// recovery.
+    ///
+    /// @scope: INTERNAL
+    /// @context: ANY
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Init(void)
+    {
+        Clock(IIC_SPEED_DEFAULT);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Profile
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: addr - device address
+    /// @param: create - claim a free entry if the device has none
+    /// @return: the device's profile, or NULL if it has none (or the table is
+    ///          full)
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static IICPROFILE * Profile(uint8_t addr, bool create)
+    {
+        IICPROFILE * pFree = NULL;
+
+        addr &= 0xfe;
+        for (uint8_t idx = 0; idx < IIC_MAX_PROFILES; idx++)
+        {
+            IICPROFILE * pProfile = &IICBlock.profiles[idx];
+            if (pProfile->addr == addr)
+            {
+                return pProfile;
+            }
+            if (!pFree && !pProfile->addr)
+            {
+                pFree = pProfile;
+            }
+        }
+        if (create && pFree)
+        {
+            pFree->addr = addr;
+            pFree->speed = IIC_SPEED_DEFAULT;
+            pFree->writeMs = 0;
+            pFree->busy = 0;
+            return pFree;
+        }
+        return NULL;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Release
+    ///
+    /// Free a profile that no longer holds anything but defaults
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: pProfile - profile
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Release(IICPROFILE * pProfile)
+    {
+        if ((pProfile->speed == IIC_SPEED_DEFAULT) && !pProfile->writeMs)
+        {
+            pProfile->addr = 0;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Polling
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @return: true if the device on the bus did not acknowledge its address
+    ///          because it may still be in its write cycle, so should be polled
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static bool Polling(void)
+    {
+        IICInternals * pInternals = &IICBlock;
+        IICPROFILE * pProfile = pInternals->pProfile;
+
+        return pProfile && pProfile->busy && (pInternals->seg == 0) &&
+               ((micros() - pInternals->started) < (pProfile->writeMs * 1000UL));
+    }
+
     ///////////////////////////////////////////////////////////////////////////////
     /// IIC
     ///
@@ -27,9 +230,7 @@ namespace Kernel
 
     IIC::IIC()
     {
-        // TWBR=20;		// set bit rate and prescaler
-        TWBR = 80;
-        TWSR = 0x10;
+        Init();
     }
 
     ///////////////////////////////////////////////////////////////////////////////
@@ -51,125 +252,1297 @@ namespace Kernel
     }
 
     ///////////////////////////////////////////////////////////////////////////////
-    /// IICWrite
+    /// TimeoutUs
     ///
-    /// Write a single byte of data to the IIC address
+    /// @scope: INTERNAL
+    /// @context: ANY
+    /// @param: trans - transaction
+    /// @return: the transaction's timeout in microseconds: its own, or the
+    ///          default for the number of bytes it moves
     ///
-    /// @scope: EXPORTED
-    /// @context: TASK
-    /// @param: addr - unsigned char. Address. Top 7 bits used
-    /// @param: dbyte - unsigned char. Data to send
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static unsigned long TimeoutUs(const IICTransaction * trans)
+    {
+        unsigned long bytes = 0;
+
+        if (trans->timeout)
+        {
+            return trans->timeout * 1000UL;
+        }
+        for (uint8_t idx = 0; idx < trans->nsegs; idx++)
+        {
+            bytes += trans->segs[idx].len + 1;      // and the address
+        }
+        return (IIC_TIMEOUT_MS * 1000UL) + (bytes * IIC_TIMEOUT_US_PER_BYTE);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Begin
+    ///
+    /// Start the transaction at the head of the queue, and its clock. The bus
+    /// clock is switched first if the device needs another speed. A device
+    /// that may be in its write cycle is allowed that much longer.
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: twcr - TWCR command that sends the START
     ///
     ///////////////////////////////////////////////////////////////////////////////
 
-    int IIC::IICWrite(unsigned char addr, unsigned char *dbytes, unsigned int nToSend)
+    static void Begin(uint8_t twcr)
     {
-        int rc = 0;
-        // This is out of the data sheet!
-        // Polled I2C write transfer
-
-        TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTA); // send start bit
-
-        while (!(TWCR & (1 << TWINT)))
-            ; // wait for ack
-        if (TWSR & 0x08)
-        { // start bit set
-            // send the address, with W bit set to zero
-            TWDR = addr & 0xfe;                // load address
-            TWCR = (1 << TWINT) | (1 << TWEN); // whang it in
-            while (!(TWCR & (1 << TWINT)))
-                ; // wait for complete
-            if ((TWSR & 0xf8) == 0x18)
-            { // check addr ack received
-                for (int idx = 0; (idx < nToSend); idx++)
-                {
-                    TWDR = *(dbytes + idx);            // load byte
-                    TWCR = (1 << TWINT) | (1 << TWEN); // whang it in
-                    while (!(TWCR & (1 << TWINT)))
-                        ; // wait for complete
-                    if ((TWSR & 0xf8) != 0x28)
-                    { // check for data ack received
-                        rc = -2;
-                        break;
-                    }
-                }
+        IICInternals * pInternals = &IICBlock;
+        IICPROFILE * pProfile = Profile(pInternals->pHead->addr, false);
+        uint8_t speed = (pProfile) ? pProfile->speed : (uint8_t)IIC_SPEED_DEFAULT;
+
+        if (speed != pInternals->speed)
+        {
+            Clock(speed);
+        }
+        pInternals->idx = 0;
+        pInternals->seg = 0;
+        pInternals->held = 0;
+        pInternals->pProfile = pProfile;
+        pInternals->started = micros();
+        pInternals->limit = TimeoutUs(pInternals->pHead);
+        if (pProfile && pProfile->busy)
+        {
+            pInternals->limit += pProfile->writeMs * 1000UL;
+        }
+        TWCR = twcr;
+    }
+
+#if IIC_TRACE
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// TraceRecord
+    ///
+    /// Add the transaction on the bus to the trace ring and the totals
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: trans - transaction
+    /// @param: status - its final status
+    /// @param: latency - START to completion, us
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void TraceRecord(const IICTransaction * trans, int8_t status, unsigned long latency)
+    {
+        IICInternals * pInternals = &IICBlock;
+        IICTRACESTATS * pStats = &pInternals->traceStats;
+        IICTRACE * pEntry = &pInternals->trace[pInternals->traced++ & (IIC_TRACE_DEPTH - 1)];
+        IICDEVTRACE * pDevice = NULL;
+        uint8_t addr = trans->addr & 0xfe;
+        uint8_t bucket = 0;
+        unsigned long bound = IIC_TRACE_BUCKET0_US;
+
+        pEntry->start = pInternals->started;
+        pEntry->end = pInternals->started + latency;
+        pEntry->addr = addr;
+        pEntry->status = status;
+        pEntry->bytes = 0;
+        pEntry->dir = 0;
+        for (uint8_t idx = 0; idx < trans->nsegs; idx++)
+        {
+            pEntry->bytes += trans->segs[idx].len;
+            pEntry->dir |= (trans->segs[idx].flags & IIC_SEG_READ) ? IIC_TRACE_READ : IIC_TRACE_WRITE;
+        }
+
+        while ((latency >= bound) && (bucket < IIC_TRACE_BUCKETS - 1))
+        {
+            bound <<= 1;
+            bucket++;
+        }
+        pStats->latency[bucket]++;
+        pStats->busyUs += latency;
+        pStats->transactions++;
+
+        for (uint8_t idx = 0; idx < IIC_TRACE_DEVICES; idx++)
+        {
+            IICDEVTRACE * pSlot = &pStats->devices[idx];
+            if (pSlot->addr == addr)
+            {
+                pDevice = pSlot;
+                break;
             }
-            else
+            if (!pSlot->addr)
             {
-                rc = -2;
+                pSlot->addr = addr;
+                pDevice = pSlot;
+                break;
             }
-            TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO); // send stop bit
-            while (TWCR & (1 << TWSTO))
-                ; // wait for it to be cleared
         }
-        else
+        if (status == IIC_ERR_NACK)
         {
-            rc = -1;
+            pStats->nacks++;
+        }
+        else if (status != IIC_OK)
+        {
+            pStats->errors++;
+        }
+        if (pDevice)    // table full: in the totals only
+        {
+            pDevice->transactions++;
+            pDevice->bytes += pEntry->bytes;
+            pDevice->busyUs += latency;
+            if (status == IIC_ERR_NACK)
+            {
+                pDevice->nacks++;
+            }
+            else if (status != IIC_OK)
+            {
+                pDevice->errors++;
+            }
         }
-        return rc;
     }
 
+#endif
+
     ///////////////////////////////////////////////////////////////////////////////
-    /// IICRead
+    /// Finish
     ///
-    /// Wread multiple bytes of data from the IIC address
+    /// Retire the transaction on the bus and start the next, if any. Once its
+    /// status is set the transaction may belong to the caller again (a
+    /// blocking wrapper's stack frame, for instance), so that is done last.
     ///
-    /// @scope: EXPORTED
-    /// @context: TASK
-    /// @param: addr - unsigned char. Address. Top 7 bits used
-    /// @param: dbytes - unsigned char * Pointer to buffer big enough to receive
-    ///                  data
-    /// @param: nToRecv - number of bytes to receive
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: status - final status
+    /// @param: stop - true if a STOP must be sent; false if the bus has
+    ///         already released
     ///
     ///////////////////////////////////////////////////////////////////////////////
 
-    int IIC::IICRead(unsigned char addr, unsigned char *dbytes, unsigned int nToRecv)
+    static void Finish(int8_t status, bool stop)
     {
-        int rc = 0;
-        // This is out of the data sheet!
-        // Polled I2C read transfer
-
-        TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTA); // send start bit
-        while (!(TWCR & (1 << TWINT)))
-            ; // wait for ack
-        if (TWSR & 0x08)
-        { // start bit set
-            // send the address, with W bit set to 1
-            TWDR = addr | 0x01;                // load address
-            TWCR = (1 << TWINT) | (1 << TWEN); // whang it in
-            while (!(TWCR & (1 << TWINT)))
-                ; // wait for complete
-            if ((TWSR & 0xf8) == 0x40)
-            { // check addr ack received
-                for (int idx = 0; idx < nToRecv; idx++)
-                {
-                    // check if we need ack before receiving.
-                    TWCR = (idx == (nToRecv - 1)) ? (1 << TWINT) | (1 << TWEN) : (1 << TWINT) | (1 << TWEN) | (1 << TWEA);
-                    while (!(TWCR & (1 << TWINT)))
-                        ; // wait for ready
-                    if (((TWSR & 0xf8) == 0x50) || ((TWSR & 0xf8) == 0x58))
-                    {                           // check for data ack received
-                        *(dbytes + idx) = TWDR; // load byte
-                    }
-                    else
-                    {
-                        rc = -2;
-                        break;
-                    }
-                }
+        IICInternals * pInternals = &IICBlock;
+        IICTransaction * trans = pInternals->pHead;
+        unsigned long latency;
+
+        pInternals->pHead = trans->pNext;
+        pInternals->held = 0;
+        if (!pInternals->pHead)
+        {
+            pInternals->pTail = NULL;
+        }
+        trans->pNext = NULL;
+        if (trans->callback || (trans->msgid != MSG_ID_NOMESSAGE))
+        {
+            if (pInternals->pDoneTail)
+            {
+                pInternals->pDoneTail->pNext = trans;
             }
             else
             {
-                rc = -2;
+                pInternals->pDoneHead = trans;
+            }
+            pInternals->pDoneTail = trans;
+        }
+
+        // a write starts the device's write cycle when the STOP goes out
+
+        if ((status == IIC_OK) && pInternals->pProfile && pInternals->pProfile->writeMs)
+        {
+            const IICSEGMENT * last = &trans->segs[trans->nsegs - 1];
+            if (!(last->flags & IIC_SEG_READ) && last->len)
+            {
+                pInternals->pProfile->busy = 1;
             }
-            TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO); // send stop bit
-            while (TWCR & (1 << TWSTO))
-                ; // wait for it to be cleared
+        }
+
+        latency = micros() - pInternals->started;
+        if (latency > pInternals->stats.maxLatencyUs)
+        {
+            pInternals->stats.maxLatencyUs = latency;
+        }
+        pInternals->stats.transactions++;
+        if (status != IIC_OK)
+        {
+            pInternals->stats.errors++;
+        }
+#if IIC_TRACE
+        TraceRecord(trans, status, latency);
+#endif
+
+        if (pInternals->pHead)
+        {
+            Begin((stop) ? TWCR_STOP_START : TWCR_START);
+        }
+        else if (stop)
+        {
+            TWCR = TWCR_STOP;
+        }
+        trans->status = status;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Recover
+    ///
+    /// Free a stuck bus. The TWI is switched off and SCL clocked by hand until
+    /// SDA is released, by a slave that was part way through sending a byte,
+    /// then a STOP is sent and the TWI set up again. The lines are driven open
+    /// drain: low by making the pin an output (PORT bit clear), high by letting
+    /// the pull-ups have it.
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @return: true if both lines are high afterwards
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static bool Recover(void)
+    {
+        uint8_t pullups = PORTC & (_BV(PC4) | _BV(PC5));
+        bool free;
+
+        IICBlock.stats.recoveries++;
+
+        TWCR = 0;
+        PORTC &= ~(_BV(PC4) | _BV(PC5));
+        DDRC &= ~(_BV(PC4) | _BV(PC5));
+        delayMicroseconds(IIC_RECOVERY_HALF_US);
+
+        for (uint8_t n = 0; (n < IIC_RECOVERY_CLOCKS) && !(PINC & _BV(PC4)); n++)
+        {
+            DDRC |= _BV(PC5);                       // SCL low
+            delayMicroseconds(IIC_RECOVERY_HALF_US);
+            DDRC &= ~_BV(PC5);                      // SCL high
+            delayMicroseconds(IIC_RECOVERY_HALF_US);
+        }
+
+        // STOP: SDA rises while SCL is high
+
+        DDRC |= _BV(PC5);
+        delayMicroseconds(IIC_RECOVERY_HALF_US);
+        DDRC |= _BV(PC4);
+        delayMicroseconds(IIC_RECOVERY_HALF_US);
+        DDRC &= ~_BV(PC5);
+        delayMicroseconds(IIC_RECOVERY_HALF_US);
+        DDRC &= ~_BV(PC4);
+        delayMicroseconds(IIC_RECOVERY_HALF_US);
+
+        free = (PINC & (_BV(PC4) | _BV(PC5))) == (_BV(PC4) | _BV(PC5));
+
+        PORTC |= pullups;
+        Init();
+        TWCR = _BV(TWEN);
+        return free;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Abandon
+    ///
+    /// The transaction on the bus has run out of time: recover the bus and
+    /// retire it
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Abandon(void)
+    {
+        int8_t status = (Recover()) ? IIC_ERR_TIMEOUT : IIC_ERR_STUCK;
+
+        IICBlock.stats.timeouts++;
+        Finish(status, false);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Expire
+    ///
+    /// Abandon the transaction on the bus if its timeout has passed
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Expire(void)
+    {
+        IICInternals * pInternals = &IICBlock;
+
+        if (pInternals->pHead && ((micros() - pInternals->started) >= pInternals->limit))
+        {
+            Abandon();
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// NextSegment
+    ///
+    /// The segment on the bus is done: address the device again for the next
+    /// with a repeated START, holding the bus, or finish after the last.
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void NextSegment(void)
+    {
+        IICInternals * pInternals = &IICBlock;
+
+        pInternals->idx = 0;
+        if (++pInternals->seg < pInternals->pHead->nsegs)
+        {
+            TWCR = TWCR_START;
         }
         else
         {
-            rc = -1;
+            Finish(IIC_OK, true);
         }
-        return rc;
     }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Hold
+    ///
+    /// The read on the bus has filled its buffer, its last byte acknowledged:
+    /// hold the bus until Resume. TWINT is left set, which keeps SCL low, with
+    /// the interrupt off so that it doesn't fire again. The clock restarts
+    /// for the hold, which may last IIC_HOLD_MS.
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    /// @param: trans - transaction on the bus
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Hold(IICTransaction * trans)
+    {
+        IICBlock.held = 1;
+        IICBlock.started = micros();
+        IICBlock.limit = IIC_HOLD_MS * 1000UL;
+        TWCR = _BV(TWEN);
+        trans->status = IIC_HELD;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Service
+    ///
+    /// Advance the transaction on the bus by one step. Called with TWINT set,
+    /// from the TWI interrupt or by Wait when polling.
+    ///
+    /// @scope: INTERNAL
+    /// @context: INTERRUPT (or interrupts disabled)
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static void Service(void)
+    {
+        IICInternals * pInternals = &IICBlock;
+        IICTransaction * trans = pInternals->pHead;
+        uint8_t twsr = TWSR & 0xf8;
+
+        if (!trans)
+        {
+            TWCR = _BV(TWEN);       // nothing to do: drop TWINT handling
+            return;
+        }
+        if (pInternals->held)
+        {
+            return;                 // polled while held: TWINT stays set until Resume
+        }
+
+        const IICSEGMENT * seg = &trans->segs[pInternals->seg];
+
+        switch (twsr)
+        {
+            case TW_START:
+            case TW_REP_START:
+                // address the device for this segment
+                TWDR = (seg->flags & IIC_SEG_READ) ? (trans->addr | 0x01) : (trans->addr & 0xfe);
+                TWCR = TWCR_NEXT;
+                break;
+
+            case TW_MT_SLA_ACK:
+            case TW_MT_DATA_ACK:
+                if ((twsr == TW_MT_SLA_ACK) && pInternals->pProfile)
+                {
+                    pInternals->pProfile->busy = 0;
+                }
+                // gather: carry on into following IIC_SEG_NOSTART segments
+                while ((pInternals->idx >= seg->len) &&
+                       (pInternals->seg + 1 < trans->nsegs) && (seg[1].flags & IIC_SEG_NOSTART))
+                {
+                    pInternals->seg++;
+                    pInternals->idx = 0;
+                    seg++;
+                }
+                if (pInternals->idx < seg->len)
+                {
+                    TWDR = seg->buf[pInternals->idx++];
+                    TWCR = TWCR_NEXT;
+                }
+                else
+                {
+                    NextSegment();
+                }
+                break;
+
+            case TW_MR_SLA_ACK:
+                if (pInternals->pProfile)
+                {
+                    pInternals->pProfile->busy = 0;
+                }
+                pInternals->end = seg->len;
+                pInternals->more = (seg->flags & IIC_SEG_MORE) != 0;
+                TWCR = ((pInternals->end > 1) || pInternals->more) ? TWCR_ACK : TWCR_NEXT;
+                break;
+
+            case TW_MR_DATA_ACK:
+                seg->buf[pInternals->idx++] = TWDR;
+                if (pInternals->idx >= pInternals->end)
+                {
+                    Hold(trans);            // only with more: the last byte was acknowledged
+                }
+                else
+                {
+                    TWCR = ((pInternals->idx < pInternals->end - 1) || pInternals->more) ? TWCR_ACK : TWCR_NEXT;
+                }
+                break;
+
+            case TW_MR_DATA_NACK:
+                seg->buf[pInternals->idx++] = TWDR;
+                NextSegment();
+                break;
+
+            case TW_MT_SLA_NACK:
+            case TW_MR_SLA_NACK:
+                if (Polling())
+                {
+                    // ACK polling: address it again until the write cycle ends
+                    pInternals->stats.polls++;
+                    TWCR = TWCR_STOP_START;
+                    break;
+                }
+                Finish(IIC_ERR_NACK, true);
+                break;
+
+            case TW_MT_DATA_NACK:
+                Finish(IIC_ERR_NACK, true);
+                break;
+
+            case TW_MT_ARB_LOST:
+                // the bus has been released; not ours to STOP
+                Finish(IIC_ERR_BUS, false);
+                break;
+
+            default:
+                // bus error: a STOP resets the interface
+                Finish(IIC_ERR_BUS, true);
+                break;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Valid
+    ///
+    /// @scope: INTERNAL
+    /// @context: ANY
+    /// @param: trans - transaction
+    /// @return: true if the transaction has segments, no empty reads, which the
+    ///          TWI can't do, IIC_SEG_NOSTART only on writes following writes
+    ///          and IIC_SEG_MORE only on reads
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    static bool Valid(const IICTransaction * trans)
+    {
+        if (!trans->segs || !trans->nsegs)
+        {
+            return false;
+        }
+        for (uint8_t idx = 0; idx < trans->nsegs; idx++)
+        {
+            uint8_t flags = trans->segs[idx].flags;
+
+            if ((flags & IIC_SEG_READ) && !trans->segs[idx].len)
+            {
+                return false;
+            }
+            if ((flags & IIC_SEG_NOSTART) &&
+                ((flags & IIC_SEG_READ) || !idx || (trans->segs[idx - 1].flags & IIC_SEG_READ)))
+            {
+                return false;
+            }
+            if ((flags & IIC_SEG_MORE) && !(flags & IIC_SEG_READ))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Submit
+    ///
+    /// Queue a transaction. If the bus is idle, send the START now; the rest
+    /// happens in the interrupt. A STOP from the previous transaction may
+    /// still be going out, and TWSTA must not be set until it has; if it
+    /// never goes, the bus is recovered first.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK, INTERRUPT
+    /// @param: trans - transaction, not already queued
+    /// @return: IIC_OK if queued, IIC_PENDING if already queued,
+    ///          IIC_ERR_PARAM if malformed
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Submit(IICTransaction * trans)
+    {
+        IICInternals * pInternals = &IICBlock;
+        int rc = IIC_OK;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+
+        if ((trans->status == IIC_PENDING) || (trans->status == IIC_HELD))
+        {
+            rc = IIC_PENDING;
+        }
+        else if (!Valid(trans))
+        {
+            rc = IIC_ERR_PARAM;
+        }
+        else
+        {
+            trans->pNext = NULL;
+            trans->status = IIC_PENDING;
+            if (pInternals->pTail)
+            {
+                pInternals->pTail->pNext = trans;
+                pInternals->pTail = trans;
+            }
+            else
+            {
+                pInternals->pHead = pInternals->pTail = trans;
+                for (unsigned int us = 0; TWCR & _BV(TWSTO); us++)
+                {
+                    // previous STOP still on the bus
+                    if (us >= IIC_STOP_WAIT_US)
+                    {
+                        Recover();
+                        break;
+                    }
+                    delayMicroseconds(1);
+                }
+                Begin(TWCR_START);
+            }
+        }
+        INTRestoreMasterInterrupts(sreg);
+        return rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Wait
+    ///
+    /// Wait for a submitted transaction to complete. With interrupts enabled
+    /// the CPU idles between TWI interrupts: interrupts are disabled to check
+    /// the status, and sei immediately before sleep always executes the sleep,
+    /// so the completing interrupt can't be missed. The timer tick wakes it at
+    /// least every millisecond to check the deadline. With interrupts
+    /// disabled, TWINT is polled and the state machine run directly.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK, INTERRUPT
+    /// @param: trans - transaction
+    /// @return: final status
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Wait(IICTransaction * trans)
+    {
+        if (SREG & _BV(SREG_I))
+        {
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            for (;;)
+            {
+                cli();
+                Expire();
+                if (trans->status != IIC_PENDING)
+                {
+                    sei();
+                    break;
+                }
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+        }
+        else
+        {
+            // micros() stops with interrupts off, so count the time instead
+
+            IICInternals * pInternals = &IICBlock;
+            IICTransaction * head = NULL;
+            uint8_t held = 0;
+            unsigned long waited = 0;
+
+            while (trans->status == IIC_PENDING)
+            {
+                if ((pInternals->pHead != head) || (pInternals->held != held))
+                {
+                    head = pInternals->pHead;
+                    held = pInternals->held;
+                    waited = 0;
+                }
+                if ((TWCR & _BV(TWINT)) && !held)
+                {
+                    Service();
+                }
+                else if (waited >= pInternals->limit)
+                {
+                    Abandon();
+                }
+                else
+                {
+                    delayMicroseconds(1);
+                    waited++;
+                }
+            }
+        }
+        return trans->status;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Resume
+    ///
+    /// Read on from a hold. The TWI still has TWINT set after the last byte
+    /// was acknowledged, so clearing it clocks in the next. The timeout and
+    /// the latency counted start again, for this part alone.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK, INTERRUPT
+    /// @param: trans - the held transaction
+    /// @param: len - bytes to read, 1 to the segment length
+    /// @param: more - true to hold the bus again after them
+    /// @return: IIC_OK, or IIC_ERR_PARAM if not held or len is out of range
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Resume(IICTransaction * trans, uint16_t len, bool more)
+    {
+        IICInternals * pInternals = &IICBlock;
+        int rc = IIC_ERR_PARAM;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+
+        if ((trans == pInternals->pHead) && pInternals->held && len &&
+            (len <= trans->segs[pInternals->seg].len))
+        {
+            pInternals->held = 0;
+            pInternals->idx = 0;
+            pInternals->end = len;
+            pInternals->more = more;
+            pInternals->started = micros();
+            pInternals->limit = (trans->timeout) ? trans->timeout * 1000UL :
+                                (IIC_TIMEOUT_MS * 1000UL) + ((unsigned long)len * IIC_TIMEOUT_US_PER_BYTE);
+            trans->status = IIC_PENDING;
+            TWCR = ((len > 1) || more) ? TWCR_ACK : TWCR_NEXT;
+            rc = IIC_OK;
+        }
+        INTRestoreMasterInterrupts(sreg);
+        return rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Batch
+    ///
+    /// Queue every transaction before waiting on any. Interrupts are held off
+    /// while queueing so that the queue is complete before the first
+    /// transaction can finish. The queue runs in order, so waiting on each in
+    /// turn waits no longer than waiting on the last.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK, INTERRUPT
+    /// @param: trans - array of transactions, none already queued
+    /// @param: count - number of transactions
+    /// @param: status - receives the final status of each, or NULL
+    /// @return: IIC_OK if all succeeded, else the first IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Batch(IICTransaction * trans, uint8_t count, int8_t * status)
+    {
+        int result = IIC_OK;
+        int rc;
+        uint8_t idx;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+
+        for (idx = 0; idx < count; idx++)
+        {
+            if (Submit(&trans[idx]) == IIC_ERR_PARAM)
+            {
+                trans[idx].status = IIC_ERR_PARAM;     // not queued, so ours
+            }
+        }
+        INTRestoreMasterInterrupts(sreg);
+
+        for (idx = 0; idx < count; idx++)
+        {
+            rc = Wait(&trans[idx]);
+            if (status)
+            {
+                status[idx] = rc;
+            }
+            if ((rc != IIC_OK) && (result == IIC_OK))
+            {
+                result = rc;
+            }
+        }
+        return result;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// SetSpeed
+    ///
+    /// Set the bus clock for a device. Takes effect from its next transaction.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: speed - clock profile
+    /// @return: IIC_OK or IIC_ERR_PARAM
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::SetSpeed(unsigned char addr, IICSPEED speed)
+    {
+        IICPROFILE * pProfile;
+        int rc = IIC_OK;
+
+        if ((unsigned)speed >= IIC_SPEED_COUNT)
+        {
+            return IIC_ERR_PARAM;
+        }
+
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        pProfile = Profile(addr, speed != IIC_SPEED_DEFAULT);
+        if (pProfile)
+        {
+            pProfile->speed = speed;
+            Release(pProfile);
+        }
+        else if (speed != IIC_SPEED_DEFAULT)
+        {
+            rc = IIC_ERR_PARAM;
+        }
+        INTRestoreMasterInterrupts(sreg);
+        return rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// SetWriteCycle
+    ///
+    /// Declare that a device has a write cycle after each write, during which
+    /// it does not acknowledge its address.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: ms - longest write cycle; 0 for none
+    /// @return: IIC_OK or IIC_ERR_PARAM
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::SetWriteCycle(unsigned char addr, uint8_t ms)
+    {
+        IICPROFILE * pProfile;
+        int rc = IIC_OK;
+
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        pProfile = Profile(addr, ms != 0);
+        if (pProfile)
+        {
+            pProfile->writeMs = ms;
+            pProfile->busy = (ms != 0);     // it may be mid-cycle from before a reset
+            Release(pProfile);
+        }
+        else if (ms)
+        {
+            rc = IIC_ERR_PARAM;
+        }
+        INTRestoreMasterInterrupts(sreg);
+        return rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// isReady
+    ///
+    /// @scope: EXPORTED
+    /// @context: ANY
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @return: false if the device has been written and has not acknowledged
+    ///          since, so may still be in its write cycle
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    bool IIC::isReady(unsigned char addr)
+    {
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        IICPROFILE * pProfile = Profile(addr, false);
+        bool ready = !pProfile || !pProfile->busy;
+        INTRestoreMasterInterrupts(sreg);
+        return ready;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Rate
+    ///
+    /// @scope: EXPORTED
+    /// @context: ANY
+    /// @param: speed - clock profile
+    /// @return: SCL frequency achieved, Hz
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    unsigned long IIC::Rate(IICSPEED speed)
+    {
+        return IIC_RATE(IICClocks[speed].twbr, IICClocks[speed].twps);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// WorstCaseUs
+    ///
+    /// @scope: EXPORTED
+    /// @context: ANY
+    /// @param: trans - transaction
+    /// @return: bound on the time from START to completion, us
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    unsigned long IIC::WorstCaseUs(const IICTransaction * trans)
+    {
+        return TimeoutUs(trans) + 1000UL + IIC_RECOVERY_US;     // a tick to notice
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Stats
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: NONE
+    /// @return: driver counters
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    const IICSTATS& IIC::Stats(void)
+    {
+        return IICBlock.stats;
+    }
+
+#if IIC_TRACE
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Trace
+    ///
+    /// Copy out the most recent traced transactions
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: entries - buffer
+    /// @param: max - size of the buffer, in entries
+    /// @return: number of entries copied, oldest first
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    uint8_t IIC::Trace(IICTRACE * entries, uint8_t max)
+    {
+        IICInternals * pInternals = &IICBlock;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        uint8_t traced = pInternals->traced;
+        uint8_t count = (pInternals->traceStats.transactions < IIC_TRACE_DEPTH) ?
+                        (uint8_t)pInternals->traceStats.transactions : IIC_TRACE_DEPTH;
+
+        if (count > max)
+        {
+            count = max;
+        }
+        for (uint8_t idx = 0; idx < count; idx++)
+        {
+            entries[idx] = pInternals->trace[(uint8_t)(traced - count + idx) & (IIC_TRACE_DEPTH - 1)];
+        }
+        INTRestoreMasterInterrupts(sreg);
+        return count;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// TraceStats
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: NONE
+    /// @return: traced totals
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    const IICTRACESTATS& IIC::TraceStats(void)
+    {
+        return IICBlock.traceStats;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// BusyPercent
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: NONE
+    /// @return: share of the time since the trace was reset that the bus was
+    ///          busy, percent
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    uint8_t IIC::BusyPercent(void)
+    {
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        unsigned long busy = IICBlock.traceStats.busyUs;
+        unsigned long elapsed = micros() - IICBlock.traceStats.since;
+        INTRestoreMasterInterrupts(sreg);
+
+        elapsed /= 100;                 // scaled so busy does not overflow
+        if (!elapsed)
+        {
+            return 0;
+        }
+        busy /= elapsed;
+        return (busy > 100) ? 100 : (uint8_t)busy;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// BytesPerSecond
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @return: average traffic to and from the device since the trace was
+    ///          reset, or 0 if it has not been traced
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    unsigned long IIC::BytesPerSecond(unsigned char addr)
+    {
+        unsigned long bytes = 0;
+        unsigned long elapsed;
+
+        addr &= 0xfe;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        for (uint8_t idx = 0; idx < IIC_TRACE_DEVICES; idx++)
+        {
+            if (addr && (IICBlock.traceStats.devices[idx].addr == addr))
+            {
+                bytes = IICBlock.traceStats.devices[idx].bytes;
+            }
+        }
+        elapsed = (micros() - IICBlock.traceStats.since) / 1000;
+        INTRestoreMasterInterrupts(sreg);
+        return (elapsed) ? (bytes * 1000UL) / elapsed : 0;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// ResetTrace
+    ///
+    /// Empty the ring and zero the totals
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: NONE
+    /// @return: NONE
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    void IIC::ResetTrace(void)
+    {
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+        memset(&IICBlock.traceStats, 0, sizeof(IICBlock.traceStats));
+        IICBlock.traced = 0;
+        IICBlock.traceStats.since = micros();
+        INTRestoreMasterInterrupts(sreg);
+    }
+
+#endif
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// isBusy
+    ///
+    /// @scope: EXPORTED
+    /// @context: ANY
+    /// @param: NONE
+    /// @return: true while transactions are queued or on the bus
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    bool IIC::isBusy(void)
+    {
+        return IICBlock.pHead != NULL;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Completed
+    ///
+    /// @scope: EXPORTED
+    /// @context: ANY
+    /// @param: NONE
+    /// @return: true if completions are waiting to be delivered by Loop
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    bool IIC::Completed(void)
+    {
+        return IICBlock.pDoneHead != NULL;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Loop
+    ///
+    /// Abandon the transaction on the bus if it has run out of time, then
+    /// deliver completions at task time. Each transaction is taken off the done
+    /// list before its callback runs, so the callback may submit it again.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: NONE
+    /// @return: number of completions delivered
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    uint8_t IIC::Loop(void)
+    {
+        IICInternals * pInternals = &IICBlock;
+        uint8_t delivered = 0;
+        uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+
+        Expire();
+        INTRestoreMasterInterrupts(sreg);
+
+        while (pInternals->pDoneHead)
+        {
+            sreg = INTSaveAndDisableMasterInterrupts();
+            IICTransaction * trans = pInternals->pDoneHead;
+            pInternals->pDoneHead = trans->pNext;
+            if (!pInternals->pDoneHead)
+            {
+                pInternals->pDoneTail = NULL;
+            }
+            trans->pNext = NULL;
+            INTRestoreMasterInterrupts(sreg);
+
+            if (trans->callback)
+            {
+                trans->callback(trans);
+            }
+            else
+            {
+                MQClass::Get().Post(trans->msgid, trans, MQ_OWNER_CALLER, MQ_CONTEXT_TASK);
+            }
+            delivered++;
+        }
+        return delivered;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Transfer
+    ///
+    /// Run a list of segments as one bus transaction, blocking until done
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: segs - segment list
+    /// @param: nsegs - number of segments
+    /// @return: IIC_OK or IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Transfer(unsigned char addr, const IICSEGMENT *segs, uint8_t nsegs)
+    {
+        IICTransaction trans(addr, segs, nsegs);
+        int rc = Submit(&trans);
+
+        return (rc == IIC_OK) ? Wait(&trans) : rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Transfer
+    ///
+    /// Write, then read back after a repeated START
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: wbytes - data to send
+    /// @param: nToSend - number of bytes to send
+    /// @param: rbytes - buffer big enough to receive the data
+    /// @param: nToRecv - number of bytes to receive
+    /// @return: IIC_OK or IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Transfer(unsigned char addr, const void *wbytes, unsigned int nToSend, void *rbytes, unsigned int nToRecv)
+    {
+        IICSEGMENT segs[2] = {
+            { (uint8_t *)wbytes, (uint16_t)nToSend, IIC_SEG_WRITE },
+            { (uint8_t *)rbytes, (uint16_t)nToRecv, IIC_SEG_READ }
+        };
+
+        return Transfer(addr, segs, 2);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// Stream
+    ///
+    /// A write and a read flagged IIC_SEG_MORE, resumed after each buffer
+    /// until nToRecv bytes are in. The sink is offered what it has not yet
+    /// taken until it has all of it; meanwhile the bus is held. If it stops
+    /// the stream, one more byte is read, not acknowledged, to end the read.
+    /// Each part may wait IIC_HOLD_MS for the sink in all, time in the sink
+    /// included: then a held read is abandoned and the bus recovered. With
+    /// interrupts off micros() stops, so only the idle time between offers
+    /// is counted, as Wait does. The hold may also be abandoned from
+    /// elsewhere, by a Wait that the sink itself makes on another transaction.
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: wbytes - data to send
+    /// @param: nToSend - number of bytes to send
+    /// @param: rbytes - buffer for each part of the data
+    /// @param: size - its size
+    /// @param: nToRecv - number of bytes to receive
+    /// @param: sink - takes each part
+    /// @param: context - passed to the sink
+    /// @return: IIC_OK, IIC_STOPPED or IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::Stream(unsigned char addr, const void *wbytes, unsigned int nToSend, void *rbytes, unsigned int size,
+                    unsigned long nToRecv, PFNIICSINK sink, void *context)
+    {
+        IICSEGMENT segs[2] = {
+            { (uint8_t *)wbytes, (uint16_t)nToSend, IIC_SEG_WRITE },
+            { (uint8_t *)rbytes, (uint16_t)size, IIC_SEG_READ | IIC_SEG_MORE }
+        };
+        IICTransaction trans(addr, segs, 2);
+        bool stop = false;
+        int rc;
+
+        if (!nToRecv || !size || !sink)
+        {
+            return IIC_ERR_PARAM;
+        }
+        if (nToRecv <= size)
+        {
+            segs[1].len = nToRecv;
+            segs[1].flags = IIC_SEG_READ;
+        }
+
+        rc = Submit(&trans);
+        while (rc == IIC_OK)
+        {
+            rc = Wait(&trans);
+            if ((rc != IIC_OK) && (rc != IIC_HELD))
+            {
+                break;
+            }
+
+            uint16_t len = (nToRecv < size) ? nToRecv : size;
+            unsigned long since = micros();     // the part came in
+            unsigned long waited = 0;           // idle us, with interrupts off
+            for (uint16_t done = 0; !stop && (done < len); )
+            {
+                int took = sink(context, (const uint8_t *)rbytes + done, len - done);
+                if (took < 0)
+                {
+                    stop = true;
+                    break;
+                }
+                done += took;
+                if (!took)
+                {
+                    delayMicroseconds(1);
+                    waited++;
+                }
+                if ((rc == IIC_HELD) && (trans.status != IIC_HELD))
+                {
+                    return trans.status;        // abandoned while the sink had it
+                }
+                if ((done < len) &&
+                    (((SREG & _BV(SREG_I)) ? (micros() - since) : waited) >= IIC_HOLD_MS * 1000UL))
+                {
+                    uint8_t sreg = INTSaveAndDisableMasterInterrupts();
+                    if (trans.status == IIC_HELD)
+                    {
+                        Abandon();
+                    }
+                    INTRestoreMasterInterrupts(sreg);
+                    return IIC_ERR_TIMEOUT;
+                }
+            }
+            nToRecv -= len;
+
+            if (rc == IIC_OK)
+            {
+                break;
+            }
+            if (stop)
+            {
+                nToRecv = 1;
+            }
+            rc = Resume(&trans, (nToRecv < size) ? nToRecv : size, nToRecv > size);
+        }
+        return ((rc == IIC_OK) && stop) ? IIC_STOPPED : rc;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICWrite
+    ///
+    /// Write a block of data to the IIC address, blocking until done
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: dbytes - data to send
+    /// @param: nToSend - number of bytes to send
+    /// @return: IIC_OK or IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::IICWrite(unsigned char addr, unsigned char *dbytes, unsigned int nToSend)
+    {
+        IICSEGMENT seg = { dbytes, (uint16_t)nToSend, IIC_SEG_WRITE };
+
+        return Transfer(addr, &seg, 1);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICRead
+    ///
+    /// Read multiple bytes of data from the IIC address, blocking until done
+    ///
+    /// @scope: EXPORTED
+    /// @context: TASK
+    /// @param: addr - unsigned char. Address. Top 7 bits used
+    /// @param: dbytes - unsigned char * Pointer to buffer big enough to receive
+    ///                  data
+    /// @param: nToRecv - number of bytes to receive
+    /// @return: IIC_OK or IIC_ERR_*
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    int IIC::IICRead(unsigned char addr, unsigned char *dbytes, unsigned int nToRecv)
+    {
+        IICSEGMENT seg = { dbytes, (uint16_t)nToRecv, IIC_SEG_READ };
+
+        return Transfer(addr, &seg, 1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// TWI interrupt
+///////////////////////////////////////////////////////////////////////////////
+
+ISR(TWI_vect)
+{
+    Kernel::Service();
 }
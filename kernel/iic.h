@@ -10,14 +10,298 @@
 #ifndef _IIC_H_
 #define _IIC_H_
 
-///
-/// IIC reconstructed as a class. This will be a singleton class that allows
-/// access to IIC functions
+#include <stdint.h>
+#include <stddef.h>
+#include "mq.h"
+
+// transaction status
+
+#define IIC_OK						0
+#define IIC_PENDING					1		// queued or on the bus
+#define IIC_HELD					2		// a read paused with its buffer full; see IIC::Resume
+#define IIC_STOPPED					3		// a stream ended early by its sink
+#define IIC_ERR_START				-1		// START could not be sent
+#define IIC_ERR_NACK				-2		// address or data not acknowledged
+#define IIC_ERR_BUS					-3		// bus error or arbitration lost
+#define IIC_ERR_PARAM				-4		// malformed transaction
+#define IIC_ERR_TIMEOUT				-5		// timed out; the bus was recovered
+#define IIC_ERR_STUCK				-6		// timed out; the bus is still held low
+
+// Timeouts. A transaction that has not completed this long after its START
+// is abandoned and the bus recovered. Unless the transaction sets its own
+// timeout, it gets the base time plus an allowance per byte, enough for the
+// slowest bus clock.
+
+#ifndef IIC_TIMEOUT_MS
+#define IIC_TIMEOUT_MS				10
+#endif
+
+#ifndef IIC_TIMEOUT_US_PER_BYTE
+#define IIC_TIMEOUT_US_PER_BYTE		100
+#endif
+
+// longest a read flagged IIC_SEG_MORE may hold the bus with its buffer full,
+// waiting to be resumed, before it is abandoned like a transaction out of time
+
+#ifndef IIC_HOLD_MS
+#define IIC_HOLD_MS					100
+#endif
+
+// longest wait for a STOP to leave the bus before a START
+
+#ifndef IIC_STOP_WAIT_US
+#define IIC_STOP_WAIT_US			100
+#endif
+
+// Bus clock profiles (IICSPEED). SCL = F_CPU / (16 + 2 * TWBR * prescale),
+// with the prescaler (1, 4, 16 or 64) and TWBR worked out at compile time for
+// each target, rounding so the bus is never faster than asked. Where F_CPU is
+// too slow for a target, the fastest the TWI can do (TWBR 0) is used instead.
+
+#define IIC_SCL_100K				100000UL
+#define IIC_SCL_400K				400000UL
+#define IIC_SCL_1M					1000000UL
+
+#define IIC_DIV(scl)				((F_CPU + (scl) - 1) / (scl))
+#define IIC_TWBR_PS(scl, ps)		((IIC_DIV(scl) > 16) ? ((IIC_DIV(scl) - 16 + 2 * (ps) - 1) / (2 * (ps))) : 0)
+#define IIC_TWPS(scl)				((IIC_TWBR_PS(scl, 1) <= 255) ? 0 : \
+									 (IIC_TWBR_PS(scl, 4) <= 255) ? 1 : \
+									 (IIC_TWBR_PS(scl, 16) <= 255) ? 2 : 3)
+#define IIC_TWBR(scl)				IIC_TWBR_PS(scl, 1 << (2 * IIC_TWPS(scl)))
+#define IIC_RATE(twbr, twps)		(F_CPU / (16 + 2UL * (twbr) * (1 << (2 * (twps)))))
+
+// Devices with no profile set run at the default speed, which every IIC
+// device supports. Up to IIC_MAX_PROFILES devices may have a speed or a write
+// cycle of their own.
+
+#ifndef IIC_SPEED_DEFAULT
+#define IIC_SPEED_DEFAULT			IIC_SPEED_100K
+#endif
+
+#ifndef IIC_MAX_PROFILES
+#define IIC_MAX_PROFILES			4
+#endif
+
+// Bus recovery: SCL is clocked by hand until the slave holding SDA lets go
+// (at most a byte and its ACK), then a STOP is sent. Half periods are for
+// 100 kHz, which every slave supports.
+
+#define IIC_RECOVERY_CLOCKS			9
+#define IIC_RECOVERY_HALF_US		5
+#define IIC_RECOVERY_US				((IIC_RECOVERY_CLOCKS + 2) * 2 * IIC_RECOVERY_HALF_US)
+
+// Tracing. With IIC_TRACE set, the last IIC_TRACE_DEPTH transactions are
+// kept in a ring, and the bus time, traffic, errors and latencies are counted
+// for up to IIC_TRACE_DEVICES devices. Unset, as by default, none of it is
+// compiled in.
+
+#ifndef IIC_TRACE
+#define IIC_TRACE					0
+#endif
+
+#ifndef IIC_TRACE_DEPTH
+#define IIC_TRACE_DEPTH				16			// power of 2
+#endif
+
+#ifndef IIC_TRACE_DEVICES
+#define IIC_TRACE_DEVICES			4
+#endif
+
+// latency histogram: under 64 us, doubling to 4 ms and over
+
+#define IIC_TRACE_BUCKETS			8
+#define IIC_TRACE_BUCKET0_US		64
+
+// trace entry direction flags
+
+#define IIC_TRACE_WRITE				0x01
+#define IIC_TRACE_READ				0x02
+
+// segment flags
+
+#define IIC_SEG_WRITE				0x00
+#define IIC_SEG_READ				0x01
+#define IIC_SEG_NOSTART				0x02		// write straight on from the previous write
+#define IIC_SEG_MORE				0x04		// read: hold the bus when the buffer is full
+
+// the Arduino 'loop' function is declared with 'C' linkage, not C++
+
+extern "C" void loop();
 
 namespace Kernel {
 
+    //
+    // bus clock profiles
+
+    typedef enum IICSPEED {
+        IIC_SPEED_100K,                 // standard mode
+        IIC_SPEED_400K,                 // fast mode
+        IIC_SPEED_1M,                   // fast mode plus
+        IIC_SPEED_COUNT
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICSEGMENT
+    ///
+    /// One segment of a transaction: len bytes written from, or read into, buf.
+    /// Each segment is addressed after a START, the first after a START and the
+    /// rest after a repeated START, so the bus is held from the first segment
+    /// to the STOP after the last. A read segment must be at least one byte; a
+    /// zero length write just addresses the device.
+    ///
+    /// A write segment flagged IIC_SEG_NOSTART following a write is sent on in
+    /// the same bus write, with no START or address. This gathers a write from
+    /// several buffers, such as a memory address and the data to store there,
+    /// without copying them together first.
+    ///
+    /// A read segment flagged IIC_SEG_MORE acknowledges its last byte, so the
+    /// device has the next one ready, and holds the bus (SCL low) with the
+    /// transaction IIC_HELD. IIC::Resume reads on into the same buffer. This
+    /// streams a sequential read of any length through a small buffer, after
+    /// addressing the device once.
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    typedef struct IICSEGMENT {
+        uint8_t *       buf;
+        uint16_t        len;
+        uint8_t         flags;          // IIC_SEG_*
+    } IICSEGMENT, *PIICSEGMENT;
+
+    class IICTransaction;
+
+    typedef void (*PFNIICCALLBACK)(IICTransaction * trans);
+
+    // takes streamed data: returns the number of bytes it took, which may be
+    // fewer than offered, or negative to stop the stream
+
+    typedef int (*PFNIICSINK)(void * context, const uint8_t * buf, uint16_t len);
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICTransaction
+    ///
+    /// One bus transaction: a list of segments to the device at addr (8-bit
+    /// address, R/W bit ignored), for example write the register address, then
+    /// read the registers. The caller owns the transaction, the segment list
+    /// and the buffers, and must leave them alone until it completes.
+    ///
+    /// On completion, the callback is called, or the message posted with the
+    /// transaction as its context (owned by the caller), at task time. With
+    /// neither, the caller polls status or uses IIC::Wait.
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    class IICTransaction {
+
+        public:
+
+            IICTransaction *    pNext;          // queue link, owned by the driver
+
+            uint8_t             addr;
+            const IICSEGMENT *  segs;
+            uint8_t             nsegs;
+
+            PFNIICCALLBACK      callback;
+            void *              context;        // for the caller's use
+            int                 msgid;
+
+            uint16_t            timeout;        // ms from START, 0 for the default
+
+            volatile int8_t     status;         // IIC_OK, IIC_PENDING, IIC_HELD or IIC_ERR_*
+
+            IICTransaction(uint8_t addr=0, const IICSEGMENT * segs=NULL, uint8_t nsegs=0) :
+                pNext(NULL), addr(addr), segs(segs), nsegs(nsegs),
+                callback(NULL), context(NULL), msgid(MSG_ID_NOMESSAGE), timeout(0), status(IIC_OK) {};
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICSTATS
+    ///
+    /// Driver counters, since reset. Latency is from START to completion.
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    typedef struct IICSTATS {
+        unsigned long   transactions;       // completed, successfully or not
+        unsigned long   errors;             // completed with IIC_ERR_*
+        unsigned long   timeouts;           // of which timed out
+        unsigned long   recoveries;         // bus recoveries
+        unsigned long   polls;              // ACK polls of devices in their write cycle
+        unsigned long   maxLatencyUs;       // longest transaction
+    } IICSTATS;
+
+#if IIC_TRACE
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICTRACE
+    ///
+    /// One traced transaction. Times are micros() at the START and at
+    /// completion; the byte count is what the transaction asked for.
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    typedef struct IICTRACE {
+        unsigned long   start;
+        unsigned long   end;
+        uint16_t        bytes;
+        uint8_t         addr;
+        uint8_t         dir;                // IIC_TRACE_WRITE | IIC_TRACE_READ
+        int8_t          status;             // IIC_OK or IIC_ERR_*
+    } IICTRACE;
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// IICTRACESTATS
+    ///
+    /// Traced totals since the trace was reset, overall and per device
+    ///
+    ///////////////////////////////////////////////////////////////////////////////
+
+    typedef struct IICDEVTRACE {
+        uint8_t         addr;               // 0 if unused
+        unsigned long   transactions;
+        unsigned long   bytes;
+        unsigned long   nacks;
+        unsigned long   errors;             // other than NACK
+        unsigned long   busyUs;
+    } IICDEVTRACE;
+
+    typedef struct IICTRACESTATS {
+        unsigned long   since;              // micros() at reset
+        unsigned long   busyUs;             // START to completion, all devices
+        unsigned long   transactions;
+        unsigned long   nacks;
+        unsigned long   errors;             // other than NACK
+        unsigned long   latency[IIC_TRACE_BUCKETS];
+        IICDEVTRACE     devices[IIC_TRACE_DEVICES];
+    } IICTRACESTATS;
+
+#endif
+
+    ///
+    /// IIC reconstructed as a class. This will be a singleton class that allows
+    /// access to IIC functions
+
     class IIC {
 
+        private:
+
+            friend void ::loop();       // the kernel delivers completions
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Loop
+            ///
+            /// Called by the kernel at task time to call the callbacks and post the
+            /// messages of completed transactions
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: NONE
+            /// @return: number of completions delivered
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            uint8_t Loop(void);
+
         public:
 
             ///////////////////////////////////////////////////////////////////////////////
@@ -47,16 +331,352 @@ namespace Kernel {
 			///////////////////////////////////////////////////////////////////////////////
 
 			static IIC& Get(void);
-            
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Submit
+            ///
+            /// Queue a transaction and return at once. Transactions run in order,
+            /// driven by the TWI interrupt, back to back on the bus.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK, INTERRUPT
+            /// @param: trans - transaction, not already queued
+            /// @return: IIC_OK if queued, IIC_PENDING if the transaction is already
+            ///          queued, IIC_ERR_PARAM if it has no segments, an empty
+            ///          read or a misplaced IIC_SEG_NOSTART
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Submit(IICTransaction * trans);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Wait
+            ///
+            /// Wait for a submitted transaction to complete. The CPU idles while the
+            /// bus works. If interrupts are disabled the bus is driven by polling
+            /// instead, so this also works from an interrupt handler.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK, INTERRUPT
+            /// @param: trans - transaction
+            /// @return: final status, IIC_OK or IIC_ERR_*, or IIC_HELD when a read
+            ///          flagged IIC_SEG_MORE has filled its buffer
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Wait(IICTransaction * trans);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Resume
+            ///
+            /// Carry on a held read: the next len bytes go into the segment's buffer
+            /// from the start. With more, the bus is held again when they are in;
+            /// without, the last is not acknowledged and the transaction finishes.
+            /// The bus is the held transaction's until then, so every other waits
+            /// behind it, but for no more than IIC_HOLD_MS: then the transaction is
+            /// abandoned with IIC_ERR_TIMEOUT. Its timeout runs again from the
+            /// resume.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK, INTERRUPT
+            /// @param: trans - the held transaction
+            /// @param: len - bytes to read, 1 to the segment length
+            /// @param: more - true to hold the bus again after them
+            /// @return: IIC_OK, or IIC_ERR_PARAM if the transaction is not held or
+            ///          len is out of range
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Resume(IICTransaction * trans, uint16_t len, bool more);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Batch
+            ///
+            /// Run independent transactions, to any devices, back to back: all are
+            /// queued at once, so each starts (with a STOP and START) from the
+            /// interrupt that ends the one before, and the bus is not left idle
+            /// between them. Blocks until all have completed.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK, INTERRUPT
+            /// @param: trans - array of transactions, none already queued
+            /// @param: count - number of transactions
+            /// @param: status - receives the final status of each, or NULL
+            /// @return: IIC_OK if all succeeded, else the first IIC_ERR_*
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Batch(IICTransaction * trans, uint8_t count, int8_t * status);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// isBusy
+            ///
+            /// @scope: EXPORTED
+            /// @context: ANY
+            /// @param: NONE
+            /// @return: true while transactions are queued or on the bus
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            bool isBusy(void);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Completed
+            ///
+            /// @scope: EXPORTED
+            /// @context: ANY
+            /// @param: NONE
+            /// @return: true if completions are waiting to be delivered at task time
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            bool Completed(void);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// SetSpeed
+            ///
+            /// Set the bus clock for a device. The driver switches the clock before
+            /// each transaction to suit the device addressed, so slow and fast
+            /// devices can share the bus. Speeds and write cycles share a table
+            /// of IIC_MAX_PROFILES devices.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @param: speed - clock profile; IIC_SPEED_DEFAULT forgets the device
+            /// @return: IIC_OK, or IIC_ERR_PARAM if the profile table is full or the
+            ///          speed is out of range
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int SetSpeed(unsigned char addr, IICSPEED speed);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Rate
+            ///
+            /// @scope: EXPORTED
+            /// @context: ANY
+            /// @param: speed - clock profile
+            /// @return: the SCL frequency the profile actually achieves at F_CPU, Hz
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            static unsigned long Rate(IICSPEED speed);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// SetWriteCycle
+            ///
+            /// Declare that a device, an EEPROM say, has a write cycle after each
+            /// write during which it ignores its address. The driver then tracks
+            /// the cycle: the next transaction to the device polls it for ACK,
+            /// readdressing it until it answers, and runs the moment it does.
+            /// Nobody has to wait a fixed time after a write. The device starts out
+            /// as if just written, since it may still be in a cycle begun before a
+            /// reset; if it is idle, that costs the first transaction nothing more
+            /// than the ACK it would get anyway.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @param: ms - longest write cycle; polling gives up after this long.
+            ///         0 for none
+            /// @return: IIC_OK, or IIC_ERR_PARAM if the profile table is full
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int SetWriteCycle(unsigned char addr, uint8_t ms);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// isReady
+            ///
+            /// @scope: EXPORTED
+            /// @context: ANY
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @return: false while a device with a write cycle has been written and
+            ///          not acknowledged since; a transaction to it now would poll
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            bool isReady(unsigned char addr);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// WorstCaseUs
+            ///
+            /// The guaranteed bound on a transaction's time on the bus: its timeout,
+            /// a timer tick for the deadline to be noticed by Wait, which checks
+            /// it every tick, then the bus recovery. A transaction that nobody
+            /// Waits for is checked by the kernel each pass instead, so add the
+            /// longest kernel pass for those. A held read is bounded the same way
+            /// for each part, and for each hold by IIC_HOLD_MS.
+            ///
+            /// @scope: EXPORTED
+            /// @context: ANY
+            /// @param: trans - transaction
+            /// @return: microseconds from START to completion, at most
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            static unsigned long WorstCaseUs(const IICTransaction * trans);
+
+#if IIC_TRACE
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Trace
+            ///
+            /// Copy out the most recent traced transactions
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: entries - buffer
+            /// @param: max - size of the buffer, in entries
+            /// @return: number of entries copied, oldest first
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            uint8_t Trace(IICTRACE * entries, uint8_t max);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// TraceStats
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: NONE
+            /// @return: traced totals
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            const IICTRACESTATS& TraceStats(void);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// BusyPercent
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: NONE
+            /// @return: share of the time since the trace was reset that the bus was
+            ///          busy, percent
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            uint8_t BusyPercent(void);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// BytesPerSecond
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @return: average traffic to and from the device since the trace was
+            ///          reset, or 0 if it has not been traced
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            unsigned long BytesPerSecond(unsigned char addr);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// ResetTrace
+            ///
+            /// Empty the ring and zero the totals
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: NONE
+            /// @return: NONE
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            void ResetTrace(void);
+
+#endif
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Stats
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: NONE
+            /// @return: driver counters
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            const IICSTATS& Stats(void);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Transfer
+            ///
+            /// Run a list of segments as one bus transaction, blocking until done
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @param: segs - segment list
+            /// @param: nsegs - number of segments
+            /// @return: IIC_OK or IIC_ERR_*
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Transfer(unsigned char addr, const IICSEGMENT * segs, uint8_t nsegs);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Transfer
+            ///
+            /// Write, then read back after a repeated START with no STOP in between:
+            /// the usual register or memory read
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @param: wbytes - data to send (register or memory address)
+            /// @param: nToSend - number of bytes to send
+            /// @param: rbytes - buffer big enough to receive the data
+            /// @param: nToRecv - number of bytes to receive
+            /// @return: IIC_OK or IIC_ERR_*
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Transfer(unsigned char addr, const void * wbytes, unsigned int nToSend, void * rbytes, unsigned int nToRecv);
+
+            ///////////////////////////////////////////////////////////////////////////////
+            /// Stream
+            ///
+            /// Write, then read any number of bytes back after a repeated START, a
+            /// buffer at a time, passing each to a sink: a sequential memory read
+            /// with one address write, whatever its length. The bus is held while
+            /// the sink is behind, which is the sink's backpressure: a device that
+            /// streams, such as an E2, waits for the clock. A sink that takes
+            /// nothing for IIC_HOLD_MS times the stream out.
+            ///
+            /// @scope: EXPORTED
+            /// @context: TASK
+            /// @param: addr - unsigned char. Address. Top 7 bits used
+            /// @param: wbytes - data to send (register or memory address)
+            /// @param: nToSend - number of bytes to send
+            /// @param: rbytes - buffer for each part of the data
+            /// @param: size - its size
+            /// @param: nToRecv - number of bytes to receive
+            /// @param: sink - called at task time with each part, until it has taken
+            ///                it all
+            /// @param: context - passed to the sink
+            /// @return: IIC_OK, IIC_STOPPED if the sink stopped the stream, or
+            ///          IIC_ERR_*
+            ///
+            ///////////////////////////////////////////////////////////////////////////////
+
+            int Stream(unsigned char addr, const void * wbytes, unsigned int nToSend, void * rbytes, unsigned int size,
+                       unsigned long nToRecv, PFNIICSINK sink, void * context);
+
             ///////////////////////////////////////////////////////////////////////////////
             /// IICWrite
             ///
-            /// Write a single byte of data to the IIC address
+            /// Write a block of data to the IIC address, blocking until done. A thin
+            /// wrapper over Submit and Wait.
             ///
-            /// @scope: INTERNAL
+            /// @scope: EXPORTED
             /// @context: TASK
             /// @param: addr - unsigned char. Address. Top 7 bits used
-            /// @param: dbyte - unsigned char. Data to send
+            /// @param: dbytes - data to send
+            /// @param: nToSend - number of bytes to send
+            /// @return: IIC_OK or IIC_ERR_*
             ///
             ///////////////////////////////////////////////////////////////////////////////
 
@@ -65,19 +685,21 @@ namespace Kernel {
             ///////////////////////////////////////////////////////////////////////////////
             /// IICRead
             ///
-            /// Wread multiple bytes of data from the IIC address
+            /// Read multiple bytes of data from the IIC address, blocking until done.
+            /// A thin wrapper over Submit and Wait.
             ///
-            /// @scope: INTERNAL
+            /// @scope: EXPORTED
             /// @context: TASK
             /// @param: addr - unsigned char. Address. Top 7 bits used
             /// @param: dbytes - unsigned char * Pointer to buffer big enough to receive
             ///                  data
             /// @param: nToRecv - number of bytes to receive
+            /// @return: IIC_OK or IIC_ERR_*
             ///
             ///////////////////////////////////////////////////////////////////////////////
 
             int IICRead(unsigned char addr,unsigned char * dbytes, unsigned int nToRecv);
     };
 }
-        
+
 #endif
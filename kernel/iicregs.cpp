@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////////
+/// iicregs.cpp
+///
+/// Register-map cache for IIC devices addressed by an 8-bit register pointer
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iicregs.h"
+#include <string.h>
+
+namespace Kernel {
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICRegisterMap
+	///
+	/// CONSTRUCTOR, PROTECTED
+	///
+	/// Nothing is cached and nothing volatile to start with
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	IICRegisterMap::IICRegisterMap(uint8_t addr, uint8_t nregs, uint8_t * values, uint8_t * flags) :
+		addr(addr), nregs(nregs), values(values), flags(flags)
+	{
+		memset(flags,0,nregs);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// SetVolatile
+	///
+	/// Volatile registers drop anything cached or staged for them
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICRegisterMap::SetVolatile(uint8_t first, uint8_t count)
+	{
+		if(Range(first,count)) {
+			for(uint8_t reg=first;reg<first+count;reg++) {
+				flags[reg]=IIC_REG_VOLATILE;
+			}
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Read
+	///
+	/// One bus read for the whole run unless every register in it is cached
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int IICRegisterMap::Read(uint8_t first, void * buf, uint8_t count)
+	{
+		uint8_t * out=(uint8_t *)buf;
+		uint8_t reg;
+
+		if(!Range(first,count)) {
+			return IIC_ERR_PARAM;
+		}
+
+		for(reg=first;reg<first+count;reg++) {
+			if((flags[reg] & (IIC_REG_VOLATILE | IIC_REG_VALID))!=IIC_REG_VALID) {
+				break;
+			}
+		}
+		if(reg<first+count) {
+			int rc=IIC::Get().Transfer(addr,&first,1,out,count);
+			if(rc!=IIC_OK) {
+				return rc;
+			}
+		}
+
+		// fill the cache from what was read, or the result from the cache
+
+		for(uint8_t idx=0;idx<count;idx++) {
+			reg=first+idx;
+			if(flags[reg] & IIC_REG_VOLATILE) {
+				continue;
+			}
+			if(flags[reg] & IIC_REG_VALID) {
+				out[idx]=values[reg];
+			} else {
+				values[reg]=out[idx];
+				flags[reg]|=IIC_REG_VALID;
+			}
+		}
+		return IIC_OK;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Write
+	///
+	/// Write-through; a failed write leaves the registers uncached, but for
+	/// staged ones, which stay staged for the next Flush
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int IICRegisterMap::Write(uint8_t first, const void * buf, uint8_t count)
+	{
+		const uint8_t * in=(const uint8_t *)buf;
+
+		if(!Range(first,count)) {
+			return IIC_ERR_PARAM;
+		}
+
+		// register pointer and values go out as one bus write
+
+		IICSEGMENT segs[2]={
+			{ &first, 1, IIC_SEG_WRITE },
+			{ (uint8_t *)in, count, IIC_SEG_WRITE | IIC_SEG_NOSTART }
+		};
+		int rc=IIC::Get().Transfer(addr,segs,2);
+
+		for(uint8_t idx=0;idx<count;idx++) {
+			uint8_t reg=first+idx;
+			if(flags[reg] & IIC_REG_VOLATILE) {
+				continue;
+			}
+			if(rc==IIC_OK) {
+				values[reg]=in[idx];
+				flags[reg]=IIC_REG_VALID;
+			} else if(!(flags[reg] & IIC_REG_DIRTY)) {
+				flags[reg]&=~IIC_REG_VALID;
+			}
+		}
+		return rc;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Modify
+	///
+	/// Read-modify-write, skipping the write if nothing changes
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int IICRegisterMap::Modify(uint8_t reg, uint8_t mask, uint8_t bits)
+	{
+		uint8_t value;
+		int rc=Read(reg,&value);
+
+		if(rc!=IIC_OK) {
+			return rc;
+		}
+		bits=(value & ~mask) | (bits & mask);
+		if((bits==value) && !(flags[reg] & (IIC_REG_VOLATILE | IIC_REG_DIRTY))) {
+			return IIC_OK;
+		}
+		return Write(reg,bits);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Stage
+	///
+	/// Cache only, marked dirty for Flush
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int IICRegisterMap::Stage(uint8_t reg, uint8_t value)
+	{
+		if(!Range(reg,1) || (flags[reg] & IIC_REG_VOLATILE)) {
+			return IIC_ERR_PARAM;
+		}
+		values[reg]=value;
+		flags[reg]=IIC_REG_VALID | IIC_REG_DIRTY;
+		return IIC_OK;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Flush
+	///
+	/// Coalesce the dirty registers into burst writes
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int IICRegisterMap::Flush(void)
+	{
+		int result=IIC_OK;
+		uint8_t reg=0;
+
+		while(reg<nregs) {
+			if(!(flags[reg] & IIC_REG_DIRTY)) {
+				reg++;
+				continue;
+			}
+
+			// extend the burst over cached registers to the last dirty one
+
+			uint8_t end=reg+1;
+			for(uint8_t scan=reg+1;(scan<nregs) && ((flags[scan] & (IIC_REG_VOLATILE | IIC_REG_VALID))==IIC_REG_VALID);scan++) {
+				if(flags[scan] & IIC_REG_DIRTY) {
+					end=scan+1;
+				}
+			}
+
+			int rc=Write(reg,&values[reg],end-reg);
+			if((rc!=IIC_OK) && (result==IIC_OK)) {
+				result=rc;
+			}
+			reg=end;
+		}
+		return result;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Invalidate
+	///
+	/// Drop cached and staged values; volatility is kept
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	void IICRegisterMap::Invalidate(void)
+	{
+		for(uint8_t reg=0;reg<nregs;reg++) {
+			flags[reg]&=IIC_REG_VOLATILE;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// isDirty
+	///
+	/// True if anything is staged
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	bool IICRegisterMap::isDirty(void) const
+	{
+		for(uint8_t reg=0;reg<nregs;reg++) {
+			if(flags[reg] & IIC_REG_DIRTY) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,197 @@
+///////////////////////////////////////////////////////////////////////////////
+/// iicregs.h
+///
+/// Register-map cache for IIC devices addressed by an 8-bit register pointer
+///
+/// A device's registers are mirrored in RAM. Registers the device changes by
+/// itself (clocks, status flags) are marked volatile and always come from the
+/// bus; the rest are read once and served from the cache after that. Writes
+/// go through to the device, or may be staged and flushed later, when the
+/// dirty registers go out in as few burst writes as possible.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _IICREGS_H_
+#define _IICREGS_H_
+
+#include <stdint.h>
+#include "iic.h"
+
+// register flags
+
+#define IIC_REG_VOLATILE		0x01		// changed by the device: always read from the bus
+#define IIC_REG_VALID			0x02		// cached value is the device's, or pending
+#define IIC_REG_DIRTY			0x04		// cached value not yet written
+
+namespace Kernel {
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICRegisterMap
+	///
+	/// The cache logic, over storage provided by IICRegisterCache. Register
+	/// numbers are relative to the first register of the device, and a burst
+	/// may not run past the end of the map.
+	///
+	/// Not interrupt safe: use from one task only.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	class IICRegisterMap {
+
+		private:
+
+			uint8_t			addr;
+			uint8_t			nregs;
+			uint8_t *		values;
+			uint8_t *		flags;
+
+			bool Range(uint8_t first, uint8_t count) const { return count && (first+count<=nregs); };
+
+		protected:
+
+			IICRegisterMap(uint8_t addr, uint8_t nregs, uint8_t * values, uint8_t * flags);
+
+		public:
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// SetVolatile
+			///
+			/// Mark registers as changed by the device, so never cached
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: first - first register
+			/// @param: count - number of registers
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void SetVolatile(uint8_t first, uint8_t count);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Read
+			///
+			/// Read a run of registers. If all are cached no bus traffic results;
+			/// otherwise the whole run is read in one transaction and the cache
+			/// filled from it. A staged value reads back as staged.
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: first - first register
+			/// @param: buf - receives the values
+			/// @param: count - number of registers
+			/// @return: IIC_OK or IIC_ERR_*
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Read(uint8_t first, void * buf, uint8_t count);
+			int Read(uint8_t reg, uint8_t * value) { return Read(reg,value,1); };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Write
+			///
+			/// Write a run of registers through to the device in one transaction.
+			/// If it fails the registers are no longer cached, as their contents
+			/// are unknown; staged registers keep their staged values, so that a
+			/// failed Flush can be retried.
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: first - first register
+			/// @param: buf - values
+			/// @param: count - number of registers
+			/// @return: IIC_OK or IIC_ERR_*
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Write(uint8_t first, const void * buf, uint8_t count);
+			int Write(uint8_t reg, uint8_t value) { return Write(reg,&value,1); };
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Modify
+			///
+			/// Read-modify-write of one register. A cached register costs one
+			/// write, and none if its value does not change.
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: reg - register
+			/// @param: mask - bits to change
+			/// @param: bits - their new values
+			/// @return: IIC_OK or IIC_ERR_*
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Modify(uint8_t reg, uint8_t mask, uint8_t bits);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Stage
+			///
+			/// Set a register in the cache only, to be written by Flush
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: reg - register; not volatile
+			/// @param: value - value
+			/// @return: IIC_OK or IIC_ERR_PARAM
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Stage(uint8_t reg, uint8_t value);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Flush
+			///
+			/// Write the staged registers. Each stretch from a dirty register to the
+			/// last dirty register reachable through cached ones goes out as one
+			/// burst, the clean registers in between rewritten with their cached
+			/// values.
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: IIC_OK, or the first IIC_ERR_* met; what failed is still
+			///          staged
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Flush(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Invalidate
+			///
+			/// Forget all cached and staged values, e.g. after the device was reset
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Invalidate(void);
+
+			bool isDirty(void) const;
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// IICRegisterCache
+	///
+	/// Register map of N registers for the device at addr, with its storage
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	template <uint8_t N> class IICRegisterCache : public IICRegisterMap {
+
+		private:
+
+			uint8_t		cache[N];
+			uint8_t		state[N];
+
+		public:
+
+			IICRegisterCache(uint8_t addr) : IICRegisterMap(addr,N,cache,state) {};
+	};
+}
+
+#endif
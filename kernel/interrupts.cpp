@@ -7,6 +7,7 @@
 ///
 ///////////////////////////////////////////////////////////////////////////////
 
+#include "sysincs.h"
 #include "interrupts.h"
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -23,7 +24,7 @@
 
 void INTDisableMasterInterrupts(void)
 {
-	asm("cli");
+	cli();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,5 +41,41 @@ void INTDisableMasterInterrupts(void)
 
 void INTEnableMasterInterrupts(void)
 {
-	asm("sei");
+	sei();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// INTSaveAndDisableMasterInterrupts
+///
+/// Disable global interrupts, returning the previous state
+///
+/// @context: ANY
+/// @scope: EXPORTED
+/// @param: none
+/// @return: previous interrupt state (SREG)
+///
+//////////////////////////////////////////////////////////////////////////////
+
+uint8_t INTSaveAndDisableMasterInterrupts(void)
+{
+	uint8_t state=SREG;
+	cli();
+	return state;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// INTRestoreMasterInterrupts
+///
+/// Restore the global interrupt state
+///
+/// @context: ANY
+/// @scope: EXPORTED
+/// @param: state - value returned by INTSaveAndDisableMasterInterrupts
+/// @return: none
+///
+//////////////////////////////////////////////////////////////////////////////
+
+void INTRestoreMasterInterrupts(uint8_t state)
+{
+	SREG=state;
 }
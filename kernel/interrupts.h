@@ -10,6 +10,8 @@
 #ifndef INTERRUPTS_H_
 #define INTERRUPTS_H_
 
+#include <stdint.h>
+
 ///////////////////////////////////////////////////////////////////////////////
 /// INTDisableMasterInterrupts
 ///
@@ -38,6 +40,35 @@ void INTDisableMasterInterrupts(void);
 
 void INTEnableMasterInterrupts(void);
 
+///////////////////////////////////////////////////////////////////////////////
+/// INTSaveAndDisableMasterInterrupts
+///
+/// Disable global interrupts, returning the previous state so that it can be
+/// put back with INTRestoreMasterInterrupts. Use this rather than a
+/// Disable/Enable pair where the caller may already have interrupts off.
+///
+/// @context: ANY
+/// @scope: EXPORTED
+/// @param: none
+/// @return: previous interrupt state
+///
+//////////////////////////////////////////////////////////////////////////////
+
+uint8_t INTSaveAndDisableMasterInterrupts(void);
+
+///////////////////////////////////////////////////////////////////////////////
+/// INTRestoreMasterInterrupts
+///
+/// Restore the global interrupt state saved by
+/// INTSaveAndDisableMasterInterrupts
+///
+/// @context: ANY
+/// @scope: EXPORTED
+/// @param: state - value returned by INTSaveAndDisableMasterInterrupts
+/// @return: none
+///
+//////////////////////////////////////////////////////////////////////////////
 
+void INTRestoreMasterInterrupts(uint8_t state);
 
 #endif
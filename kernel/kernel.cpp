@@ -1,6 +1,7 @@
 #include "kernel.h"
 #include "mq.h"
 #include "iic.h"
+#include <avr/sleep.h>
 
 namespace Kernel {
 	Kernel::KernelClass OS;
@@ -11,9 +12,127 @@ void setup()
 	UserInit();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Idle
+///
+/// Nothing to do until the earliest task deadline or an interrupt: sleep the
+/// CPU in idle mode, which leaves the timers and TWI running. The Timer 0
+/// tick behind millis() wakes us at least every millisecond, after which the
+/// next pass comes straight back here unless the deadline has passed or an
+/// interrupt handler has posted a message. Interrupts are disabled while
+/// deciding to sleep, and sei immediately before sleep always executes the
+/// sleep, so a wake-up can't be lost between the check and the sleep. A
+/// completed bus transaction also counts as work.
+///
+/// @param: hasDeadline - false if no task is sleeping and no timer running
+///         (only an interrupt can make work)
+/// @param: deadline - millis() time of the earliest deadline
+/// @return: true if the CPU slept
+///
+///////////////////////////////////////////////////////////////////////////////
+
+static bool Idle(bool hasDeadline, unsigned long deadline)
+{
+	cli();
+	if(Kernel::OS.MessageQueue.Pending() || Kernel::OS.IICDriver.Completed() || (hasDeadline && (long)(millis()-deadline)>=0)) {
+		sei();
+		return false;
+	}
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// loop
+///
+/// One pass of the kernel. Timers that have fallen due are fired first, and
+/// completed IIC transactions delivered. Then messages are dispatched, until
+/// the queue is empty or the message share of the pass budget is spent, then
+/// tasks run with the rest of the budget, at most once each per pass. The
+/// message share adapts to the queue: it grows while messages are left over
+/// at the end of the message phase and decays while the queue keeps
+/// emptying early.
+///
+/// At least one message (if any are waiting) and one task are run every pass,
+/// so neither side can be starved however the budget is set.
+///
+/// When the queue is empty and no task is on the ring - all are sleeping
+/// until a deadline, or suspended - the pass ends by sleeping the CPU until
+/// the next task deadline or timer expiry, unless idle sleep has been
+/// disabled.
+///
+///////////////////////////////////////////////////////////////////////////////
 
 void loop(void)
 {
-	Kernel::OS.MessageQueue.Loop(2);
-	Kernel::OS.TaskManager.Loop();
+	Kernel::KernelClass& os=Kernel::OS;
+	Kernel::KERNELSTATS& stats=os.stats;
+	unsigned long start=micros();
+	unsigned long msgBudget=((unsigned long)os.passBudget*stats.msgShare)>>8;
+	unsigned long elapsed;
+
+	// timers that have fallen due, which may post messages
+
+	stats.timers+=os.Timers.Loop();
+
+	// completed bus transactions
+
+	os.IICDriver.Loop();
+
+	// messages
+
+	uint8_t pending=os.MessageQueue.Pending();
+	if(pending>stats.maxPending) {
+		stats.maxPending=pending;
+	}
+	while(pending) {
+		stats.messages+=os.MessageQueue.Loop(1);
+		pending=os.MessageQueue.Pending();
+		if((micros()-start)>=msgBudget) {
+			break;
+		}
+	}
+
+	// adapt the split for the next pass
+
+	if(pending) {
+		stats.msgShare=IMIN(stats.msgShare+16,KERNEL_MSG_SHARE_MAX);
+	} else if(stats.msgShare>KERNEL_MSG_SHARE_MIN) {
+		stats.msgShare--;
+	}
+
+	// tasks
+
+	bool more;
+	do {
+		more=os.TaskManager.Loop();
+		stats.tasks++;
+	} while(more && (micros()-start)<os.passBudget);
+
+	elapsed=micros()-start;
+	if(elapsed>os.passBudget) {
+		stats.overruns++;
+	}
+	if(elapsed>stats.maxPassUs) {
+		stats.maxPassUs=IMIN(elapsed,0xffffUL);
+	}
+	stats.passes++;
+
+	if(os.idleSleep && !os.MessageQueue.Pending() && !os.IICDriver.Completed() && !os.TaskManager.Runnable()) {
+		unsigned long deadline=0,expiry;
+		bool hasDeadline=os.TaskManager.NextWake(&deadline);
+		if(os.Timers.NextExpiry(&expiry)) {
+			if(!hasDeadline || (long)(expiry-deadline)<0) {
+				deadline=expiry;
+			}
+			hasDeadline=true;
+		}
+		if(Idle(hasDeadline,deadline)) {
+			stats.sleeps++;
+		}
+	}
 }
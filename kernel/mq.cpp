@@ -12,7 +12,9 @@
 #include "mq.h"
 #include "EventReceiver.h"
 #include "interrupts.h"
+#include "pool.h"
 #include <stdlib.h>
+#include <string.h>
 
 namespace Kernel {
 
@@ -34,6 +36,8 @@ namespace Kernel {
 			virtual boolean checkHandler(void * handler) { return (PFNMSGHANDLER)handler==msgHandler; };
 			MHFUNCTION(PFNMSGHANDLER pHandler, PMESSAGEHANDLER NextHandler) : msgHandler(pHandler), MESSAGEHANDLER(NextHandler) {};
 			virtual ~MHFUNCTION() {};
+			void * operator new(size_t size) throw();
+			void operator delete(void * ptr);
 	};
 
 	typedef class MHCLASS * PMHCLASS;
@@ -44,16 +48,62 @@ namespace Kernel {
 			virtual boolean checkHandler(void * handler) { return static_cast<EventReceiver *>(handler)==pReceiver; };
 			MHCLASS(EventReceiver * pReceiver, PMESSAGEHANDLER NextHandler) : pReceiver(pReceiver), MESSAGEHANDLER(NextHandler) {};
 			virtual ~MHCLASS() {};
+			void * operator new(size_t size) throw();
+			void operator delete(void * ptr);
 	};
 
+	// handler pools
+
+	static Pool<MHFUNCTION,MSG_MAX_FUNCTION_HANDLERS>	MHFunctionPool("MHFUNCTION");
+	static Pool<MHCLASS,MSG_MAX_CLASS_HANDLERS>			MHClassPool("MHCLASS");
+
+	void * MHFUNCTION::operator new(size_t size) throw() { return MHFunctionPool.Alloc(); }
+	void MHFUNCTION::operator delete(void * ptr) { MHFunctionPool.Free(ptr); }
+	void * MHCLASS::operator new(size_t size) throw() { return MHClassPool.Alloc(); }
+	void MHCLASS::operator delete(void * ptr) { MHClassPool.Free(ptr); }
+
+	// a message slot in the queue ring
+
+	#define MSG_OWNER_INLINE	0xff	// the payload is held in the slot
+
 	typedef class MESSAGE * 	PMESSAGE;
 	class MESSAGE {
 		public:
 			int 		msgid;
-			void *		context;
-			MQOWNER		CallerOwns;
-			PMESSAGE 	pNextMsg;
-			MESSAGE(int id, void * context, MQOWNER owner) : msgid(id),context(context),CallerOwns(owner),pNextMsg(NULL) {};
+			uint8_t		Owner;		// MQOWNER, or MSG_OWNER_INLINE
+			union {
+				void *		context;
+				uint8_t		payload[MSG_INLINE_PAYLOAD];
+			} data;
+	};
+
+	#if (MSG_QUEUE_DEPTH_HIGH & (MSG_QUEUE_DEPTH_HIGH-1)) || (MSG_QUEUE_DEPTH_HIGH > 128)
+	#error "MSG_QUEUE_DEPTH_HIGH must be a power of two, no larger than 128"
+	#endif
+	#if (MSG_QUEUE_DEPTH & (MSG_QUEUE_DEPTH-1)) || (MSG_QUEUE_DEPTH > 128)
+	#error "MSG_QUEUE_DEPTH must be a power of two, no larger than 128"
+	#endif
+	#if (MSG_QUEUE_DEPTH_LOW & (MSG_QUEUE_DEPTH_LOW-1)) || (MSG_QUEUE_DEPTH_LOW > 128)
+	#error "MSG_QUEUE_DEPTH_LOW must be a power of two, no larger than 128"
+	#endif
+
+	// Stop the compiler moving slot accesses across the publication of an
+	// index. The indices are single bytes, so reading or writing one is atomic.
+
+	#define MQ_BARRIER()		__asm__ __volatile__("" ::: "memory")
+
+	// a message ring
+	//
+	// Each priority level has a ring of slots. Tail is only written by
+	// producers (Post), Head only by the consumer (Loop). Both run freely
+	// modulo 256, so the number of messages waiting is always Tail-Head.
+
+	class MQRING {
+		public:
+			PMESSAGE			Slots;
+			uint8_t				Mask;		// depth-1
+			volatile uint8_t	Head;
+			volatile uint8_t	Tail;
 	};
 
 	// message queue block
@@ -61,10 +111,15 @@ namespace Kernel {
 	class MQInternals {
 		public:
 			PMESSAGEHANDLER		QueueBlock[MSG_MAX_MSG_IDS];
-			PMESSAGE			MsgQueueFirst;
-			PMESSAGE			MsgQueueLast;
+			MQRING				Ring[MQ_PRIORITY_LEVELS];
 	};
 
+	static MESSAGE MsgQueueHigh[MSG_QUEUE_DEPTH_HIGH];
+	static MESSAGE MsgQueueNormal[MSG_QUEUE_DEPTH];
+	static MESSAGE MsgQueueLow[MSG_QUEUE_DEPTH_LOW];
+
+	static MQInternals MQBlock;
+
 	//////////////////////////////////////////////////////////////////////////////
 	/// MQClass
 	///
@@ -80,12 +135,24 @@ namespace Kernel {
 
 	MQClass::MQClass(void)
 	{
-		MQInternals * pInternals=new MQInternals;
+		MQInternals * pInternals=&MQBlock;
 		for(int idx=0;idx<MSG_MAX_MSG_IDS;idx++) {
 			pInternals->QueueBlock[idx]=(PMESSAGEHANDLER)NULL;
 		}
-		pInternals->MsgQueueFirst=(PMESSAGE)NULL;
-		pInternals->MsgQueueLast=(PMESSAGE)NULL;
+		static const struct {
+			PMESSAGE	slots;
+			uint8_t		depth;
+		} rings[MQ_PRIORITY_LEVELS] = {
+			{ MsgQueueHigh, MSG_QUEUE_DEPTH_HIGH },
+			{ MsgQueueNormal, MSG_QUEUE_DEPTH },
+			{ MsgQueueLow, MSG_QUEUE_DEPTH_LOW },
+		};
+		for(int idx=0;idx<MQ_PRIORITY_LEVELS;idx++) {
+			pInternals->Ring[idx].Slots=rings[idx].slots;
+			pInternals->Ring[idx].Mask=rings[idx].depth-1;
+			pInternals->Ring[idx].Head=0;
+			pInternals->Ring[idx].Tail=0;
+		}
 		internals=(void *)pInternals;
 	}
 
@@ -107,6 +174,20 @@ namespace Kernel {
 		return mq;
 	}
 
+	//////////////////////////////////////////////////////////////////////////////
+	/// ~MQClass
+	///
+	/// DESTRUCTOR
+	///
+	/// This class is a singleton, part of the kernel, so this function is
+	/// not normally called
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	MQClass::~MQClass()
+	{
+	}
+
 	//////////////////////////////////////////////////////////////////////////////
 	/// Subscribe
 	///
@@ -295,6 +376,52 @@ namespace Kernel {
 		}
 	}
 
+	//////////////////////////////////////////////////////////////////////////////
+	/// Enqueue
+	///
+	/// Copy a message into the next free slot of a ring and publish it by
+	/// advancing the tail. Interrupt handlers can't be pre-empted by another
+	/// producer, so they need no masking at all. A task can be interrupted by a
+	/// posting ISR, so it masks interrupts just while it claims and fills its
+	/// slot.
+	///
+	/// @context:	TASK, INTERRUPT
+	/// @scope:     INTERNAL
+	/// @param:     ring - ring of the message's priority level
+	/// @param:     msgid - already range checked
+	/// @param:     owner - MQOWNER, or MSG_OWNER_INLINE
+	/// @param:     data - context pointer, or the payload if owner is
+	///             MSG_OWNER_INLINE
+	/// @param:     size - payload size
+	/// @param:     isIntCtx - calling context
+	/// @return:	zero if successfully posted, MQ_ERR_FULL
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	static inline int Enqueue(MQRING * ring, int msgid, uint8_t owner, const void * data, uint8_t size, MQCONTEXT isIntCtx)
+	{
+		uint8_t sreg=0;
+		int rc=MQ_ERR_FULL;
+
+		if(isIntCtx!=MQ_CONTEXT_INTERRUPT) sreg=INTSaveAndDisableMasterInterrupts();
+		uint8_t tail=ring->Tail;
+		if((uint8_t)(tail-ring->Head)<=ring->Mask) {
+			PMESSAGE slot=&ring->Slots[tail & ring->Mask];
+			slot->msgid=msgid;
+			slot->Owner=owner;
+			if(owner==MSG_OWNER_INLINE) {
+				memcpy(slot->data.payload,data,size);
+			} else {
+				slot->data.context=(void *)data;
+			}
+			MQ_BARRIER();
+			ring->Tail=tail+1;
+			rc=0;
+		}
+		if(isIntCtx!=MQ_CONTEXT_INTERRUPT) INTRestoreMasterInterrupts(sreg);
+		return rc;
+	}
+
 	//////////////////////////////////////////////////////////////////////////////
 	/// Post
 	///
@@ -308,87 +435,156 @@ namespace Kernel {
 	///	            free the context data when done.
 	/// @param:     boolean isIntCtx - set this TRUE if called from an interrupt
 	///             context.
+	/// @param:     MQPRIORITY prio - queue to post to
 	///
-	/// @return:	zero if successfully posted, nonzero if error occurred
+	/// @return:	zero if successfully posted, MQ_ERR_BADID, MQ_ERR_PRIORITY or
+	///             MQ_ERR_FULL
 	///
 	//////////////////////////////////////////////////////////////////////////////
 
-	int MQClass::Post(int msgid, void * context, MQOWNER CallerOwns, MQCONTEXT isIntCtx)
+	int MQClass::Post(int msgid, void * context, MQOWNER CallerOwns, MQCONTEXT isIntCtx, MQPRIORITY prio)
 	{
-		MQInternals * pInternals = (MQInternals *)internals;
-		int rc=-1;
-		if(isIntCtx!=MQ_CONTEXT_INTERRUPT) INTDisableMasterInterrupts();
-		if(msgid<MSG_MAX_MSG_IDS && (msgid!=MSG_ID_NOMESSAGE)) {
-			PMESSAGE newMessage=new MESSAGE(msgid,context,CallerOwns);
-			if(newMessage) {
-				if(pInternals->MsgQueueFirst==NULL) {
-
-					// the first in the list
-
-					pInternals->MsgQueueFirst=pInternals->MsgQueueLast=newMessage;
-				} else {
+		if((unsigned int)msgid>=MSG_MAX_MSG_IDS) {
+			return MQ_ERR_BADID;
+		}
+		if((unsigned int)prio>=MQ_PRIORITY_LEVELS) {
+			return MQ_ERR_PRIORITY;
+		}
+		return Enqueue(&((MQInternals *)internals)->Ring[prio],msgid,CallerOwns,context,0,isIntCtx);
+	}
 
-					// attach to the bottom
+	//////////////////////////////////////////////////////////////////////////////
+	/// PostData
+	///
+	/// Post a message with its payload copied into the message slot
+	///
+	/// @context:	TASK, INTERRUPT
+	/// @scope:     EXPORTED
+	/// @param:     int msgid
+	/// @param:     const void * data - bytes to send
+	/// @param:     uint8_t size - number of bytes, up to MSG_INLINE_PAYLOAD
+	/// @param:     MQCONTEXT isIntCtx - calling context
+	/// @param:     MQPRIORITY prio - queue to post to
+	/// @return:	zero if successfully posted, MQ_ERR_BADID, MQ_ERR_PRIORITY,
+	///             MQ_ERR_FULL or MQ_ERR_SIZE
+	///
+	//////////////////////////////////////////////////////////////////////////////
 
-					pInternals->MsgQueueLast->pNextMsg=newMessage;
-					pInternals->MsgQueueLast=newMessage;
-				}
-				rc=0;
-			}
+	int MQClass::PostData(int msgid, const void * data, uint8_t size, MQCONTEXT isIntCtx, MQPRIORITY prio)
+	{
+		if((unsigned int)msgid>=MSG_MAX_MSG_IDS) {
+			return MQ_ERR_BADID;
 		}
-		if(isIntCtx!=MQ_CONTEXT_INTERRUPT) INTEnableMasterInterrupts();
-		return rc;
+		if((unsigned int)prio>=MQ_PRIORITY_LEVELS) {
+			return MQ_ERR_PRIORITY;
+		}
+		if(size>MSG_INLINE_PAYLOAD) {
+			return MQ_ERR_SIZE;
+		}
+		return Enqueue(&((MQInternals *)internals)->Ring[prio],msgid,MSG_OWNER_INLINE,data,size,isIntCtx);
 	}
 
 	//////////////////////////////////////////////////////////////////////////////
 	/// MQLoop
 	///
-	/// Called by the task handler. Processes up to MaxMessages and returns
+	/// Called by the task handler. Processes up to MaxMessages and returns.
+	///
+	/// Each message is taken from the highest priority ring that has one
+	/// waiting, so a high priority message never waits behind a backlog of
+	/// lower ones. High priority messages are not counted against MaxMessages;
+	/// to keep a flood of them from starving the tasks, at most
+	/// MSG_QUEUE_DEPTH_HIGH of them - a full ring - are dispatched per call.
+	///
+	/// Messages are dispatched straight from their slot, which is only handed
+	/// back to the producers once every handler has run, so nothing is copied
+	/// and no interrupt masking is needed.
 	///
 	/// @context:	TASK
 	/// @scope:     EXPORTED
-	/// @param:     int MaxMessages -  maximum number of messages to process in
-	///             this iteration
-	/// @return:    none
+	/// @param:     int MaxMessages -  maximum number of normal and low priority
+	///             messages to process in this iteration
+	/// @return:    number of messages dispatched
 	///
 	//////////////////////////////////////////////////////////////////////////////
 
-	void MQClass::Loop(int MaxMessages)
+	int MQClass::Loop(int MaxMessages)
 	{
 		MQInternals * pInternals = (MQInternals *)internals;
-		while(MaxMessages) {
+		uint8_t MaxHigh=MSG_QUEUE_DEPTH_HIGH;
+		int dispatched=0;
+
+		for(;;) {
 
-			// pop the first off the queue
+			// take the oldest message from the highest priority ring that has one
 
-			INTDisableMasterInterrupts();
-			PMESSAGE msg=pInternals->MsgQueueFirst;
-			if(msg) {
-				pInternals->MsgQueueFirst=msg->pNextMsg;
-				if(pInternals->MsgQueueFirst==NULL) {
-					pInternals->MsgQueueLast=NULL;
+			MQRING * ring=NULL;
+			uint8_t head;
+			for(int prio=(MaxHigh?MQ_PRIORITY_HIGH:MQ_PRIORITY_NORMAL);prio<MQ_PRIORITY_LEVELS;prio++) {
+				if(prio!=MQ_PRIORITY_HIGH && !MaxMessages) {
+					break;
 				}
-			}
-			INTEnableMasterInterrupts();
-
-			// send it in
-			if(msg) {
-				PMESSAGEHANDLER curHandler=pInternals->QueueBlock[msg->msgid];
-				while(curHandler) {
-					curHandler->Call(msg->msgid,msg->context);
-					curHandler=curHandler->pNextHandler;
+				head=pInternals->Ring[prio].Head;
+				if(head!=pInternals->Ring[prio].Tail) {
+					ring=&pInternals->Ring[prio];
+					break;
 				}
+			}
+			if(!ring) {
+				break;
+			}
+			MQ_BARRIER();
+			PMESSAGE msg=&ring->Slots[head & ring->Mask];
 
-				// free the message
+			// send it in. Inline payloads are handed over in place.
 
-				if(msg->CallerOwns!=MQ_OWNER_CALLER) {
-					if(msg->context != NULL) {
-						delete msg->context;
-					}
+			void * context=(msg->Owner==MSG_OWNER_INLINE)?(void *)msg->data.payload:msg->data.context;
+			PMESSAGEHANDLER curHandler=pInternals->QueueBlock[msg->msgid];
+			while(curHandler) {
+				curHandler->Call(msg->msgid,context);
+				curHandler=curHandler->pNextHandler;
+			}
+
+			// free the message
+
+			if(msg->Owner==MQ_OWNER_MQ) {
+				if(context != NULL) {
+					::operator delete(context);
 				}
-				delete msg;
 			}
-			MaxMessages--;
+			MQ_BARRIER();
+			ring->Head=head+1;
+			if(ring==&pInternals->Ring[MQ_PRIORITY_HIGH]) {
+				MaxHigh--;
+			} else {
+				MaxMessages--;
+			}
+			dispatched++;
+		}
+		return dispatched;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Pending
+	///
+	/// Number of messages waiting, over all priority levels. Each index is a
+	/// single byte, so no masking is needed; the result may be stale by the
+	/// time it is used if an interrupt handler posts.
+	///
+	/// @context:	ANY
+	/// @scope:     EXPORTED
+	/// @param:     none
+	/// @return:    messages queued and not yet dispatched
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	uint8_t MQClass::Pending(void)
+	{
+		MQInternals * pInternals = (MQInternals *)internals;
+		uint8_t count=0;
+		for(int prio=0;prio<MQ_PRIORITY_LEVELS;prio++) {
+			count+=(uint8_t)(pInternals->Ring[prio].Tail-pInternals->Ring[prio].Head);
 		}
+		return count;
 	}
 
 }
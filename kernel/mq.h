@@ -21,6 +21,50 @@ namespace Kernel {
 	#define MSG_ID_NOMESSAGE			-1		// used to indicate a null message
 	#define MSG_MAX_MSG_IDS				26
 
+	// Number of message slots in the queue of each priority level. Messages are
+	// held in fixed rings, so this is the most that can be waiting at each
+	// level at any time. Each must be a power of two, no larger than 128.
+	// MSG_QUEUE_DEPTH is the normal priority queue.
+
+	#ifndef MSG_QUEUE_DEPTH_HIGH
+	#define MSG_QUEUE_DEPTH_HIGH		4
+	#endif
+
+	#ifndef MSG_QUEUE_DEPTH
+	#define MSG_QUEUE_DEPTH				16
+	#endif
+
+	#ifndef MSG_QUEUE_DEPTH_LOW
+	#define MSG_QUEUE_DEPTH_LOW			8
+	#endif
+
+	// Largest payload that can be copied into a message slot by the typed Post.
+	// Every slot carries this much space, so keep it close to the largest
+	// payload actually posted.
+
+	#ifndef MSG_INLINE_PAYLOAD
+	#define MSG_INLINE_PAYLOAD			8
+	#endif
+
+	// Subscriptions come from fixed pools: the most function and EventReceiver
+	// subscriptions that can exist at once, across all message ids
+
+	#ifndef MSG_MAX_FUNCTION_HANDLERS
+	#define MSG_MAX_FUNCTION_HANDLERS	8
+	#endif
+
+	#ifndef MSG_MAX_CLASS_HANDLERS
+	#define MSG_MAX_CLASS_HANDLERS		8
+	#endif
+
+	//
+	// Post return codes
+
+	#define MQ_ERR_BADID				-1		// message id out of range
+	#define MQ_ERR_FULL					-2		// no free slot in the queue
+	#define MQ_ERR_SIZE					-3		// payload larger than MSG_INLINE_PAYLOAD
+	#define MQ_ERR_PRIORITY				-4		// no such priority level
+
 	//
 	// context enum
 
@@ -29,8 +73,28 @@ namespace Kernel {
 		MQ_CONTEXT_INTERRUPT
 	};
 
+	//
+	// priority enum
+	//
+	// Each level has its own queue. Loop always dispatches from the highest
+	// level that has a message waiting, and high priority messages are not
+	// counted against its MaxMessages limit, so one pass of the kernel loop
+	// delivers every high priority message that was waiting when it started.
+
+	typedef enum MQPRIORITY {
+		MQ_PRIORITY_HIGH,
+		MQ_PRIORITY_NORMAL,
+		MQ_PRIORITY_LOW,
+		MQ_PRIORITY_LEVELS
+	};
+
 	//
 	// ownership enum
+	//
+	// With MQ_OWNER_MQ the queue releases the context with operator delete
+	// once all handlers have run. No destructor is called, so the context must
+	// be raw storage or an object with a trivial destructor. Prefer the typed
+	// Post, which needs no allocation at all.
 
 	typedef enum MQOWNER {
 		MQ_OWNER_CALLER,
@@ -42,6 +106,25 @@ namespace Kernel {
 
 	typedef void (* PFNMSGHANDLER)(void * context);
 
+	//////////////////////////////////////////////////////////////////////////////
+	/// MessageData
+	///
+	/// Typed view of the context of a message sent with the typed Post. The
+	/// data lives in the message slot and is only valid until the handler
+	/// returns; copy it if it is needed later.
+	///
+	/// @context:	TASK
+	/// @scope:     EXPORTED
+	/// @param:     void * context - as passed to the handler
+	/// @return:	reference to the payload
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	template <class T> inline const T& MessageData(void * context)
+	{
+		return *static_cast<const T *>(context);
+	}
+
 	//
 	// Message queue class
 
@@ -73,17 +156,19 @@ namespace Kernel {
 			//////////////////////////////////////////////////////////////////////////////
 			/// Loop
 			///
-			/// Called by the task handler. Processes up to MaxMessages and returns
+			/// Called by the task handler. Processes up to MaxMessages and returns.
+			/// Messages are taken in strict priority order. High priority messages
+			/// do not count towards MaxMessages: all those waiting are delivered.
 			///
 			/// @context:	TASK
 			/// @scope:     EXPORTED
 			/// @param:     int MaxMessages -  maximum number of messages to process in
 			///             this iteration
-			/// @return:    none
+			/// @return:    number of messages dispatched
 			///
 			//////////////////////////////////////////////////////////////////////////////
 
-			void Loop(int MaxMessages);
+			int Loop(int MaxMessages);
 
 		public:
 
@@ -113,6 +198,20 @@ namespace Kernel {
 
 			~MQClass();
 
+			//////////////////////////////////////////////////////////////////////////////
+			/// Pending
+			///
+			/// Number of messages waiting, over all priority levels
+			///
+			/// @context:	ANY
+			/// @scope:     EXPORTED
+			/// @param:     none
+			/// @return:    messages queued and not yet dispatched
+			///
+			//////////////////////////////////////////////////////////////////////////////
+
+			uint8_t Pending(void);
+
 			//////////////////////////////////////////////////////////////////////////////
 			/// Subscribe
 			///
@@ -204,17 +303,75 @@ namespace Kernel {
 			/// Post a message. Pass address of handler function to be
 			/// called.
 			///
+			/// Posting never allocates. From an interrupt (isIntCtx set to
+			/// MQ_CONTEXT_INTERRUPT) no interrupt masking is done at all; from a
+			/// task, interrupts are masked only for the few cycles it takes to claim
+			/// a slot.
+			///
 			/// @context:	TASK, INTERRUPT
 			/// @scope:     EXPORTED
 			/// @param:     int msgid
 			/// @param:     void * context - pointer to context data
 			/// @param:     boolean CallerOwns - set TRUE if the message queue is not to
 			///	            free the context data when done.
-			/// @return:	zero if successfully posted, nonzero if error occurred
+			/// @param:     MQCONTEXT isIntCtx - MQ_CONTEXT_INTERRUPT if called from an
+			///             interrupt handler
+			/// @param:     MQPRIORITY prio - queue to post to
+			/// @return:	zero if successfully posted, MQ_ERR_BADID, MQ_ERR_PRIORITY or
+			///             MQ_ERR_FULL
+			///
+			//////////////////////////////////////////////////////////////////////////////
+
+			int Post(int msgid, void * context, MQOWNER CallerOwns, MQCONTEXT isIntCtx, MQPRIORITY prio=MQ_PRIORITY_NORMAL);
+
+			//////////////////////////////////////////////////////////////////////////////
+			/// Post (typed)
+			///
+			/// Post a message carrying a copy of a small value. The value is copied
+			/// into the message slot, so nothing is allocated and the caller's copy
+			/// may go out of scope at once. Handlers receive a pointer to the copy:
+			/// use MessageData<T>(context) to read it.
+			///
+			/// T must be trivially copyable and no larger than MSG_INLINE_PAYLOAD.
+			///
+			/// @context:	TASK, INTERRUPT
+			/// @scope:     EXPORTED
+			/// @param:     int msgid
+			/// @param:     const T& data - value to send
+			/// @param:     MQCONTEXT isIntCtx - MQ_CONTEXT_INTERRUPT if called from an
+			///             interrupt handler
+			/// @param:     MQPRIORITY prio - queue to post to
+			/// @return:	zero if successfully posted, MQ_ERR_BADID, MQ_ERR_PRIORITY or
+			///             MQ_ERR_FULL
+			///
+			//////////////////////////////////////////////////////////////////////////////
+
+			template <class T> int Post(int msgid, const T& data, MQCONTEXT isIntCtx=MQ_CONTEXT_TASK, MQPRIORITY prio=MQ_PRIORITY_NORMAL)
+			{
+				static_assert(sizeof(T)<=MSG_INLINE_PAYLOAD,"payload too large for a message slot: raise MSG_INLINE_PAYLOAD");
+				return PostData(msgid,&data,sizeof(T),isIntCtx,prio);
+			}
+
+			//////////////////////////////////////////////////////////////////////////////
+			/// PostData
+			///
+			/// Untyped form of the typed Post: copy size bytes into the message
+			/// slot.
+			///
+			/// @context:	TASK, INTERRUPT
+			/// @scope:     EXPORTED
+			/// @param:     int msgid
+			/// @param:     const void * data - bytes to send
+			/// @param:     uint8_t size - number of bytes, up to MSG_INLINE_PAYLOAD
+			/// @param:     MQCONTEXT isIntCtx - MQ_CONTEXT_INTERRUPT if called from an
+			///             interrupt handler
+			/// @param:     MQPRIORITY prio - queue to post to
+			/// @return:	zero if successfully posted, MQ_ERR_BADID, MQ_ERR_PRIORITY,
+			///             MQ_ERR_FULL or MQ_ERR_SIZE
 			///
 			//////////////////////////////////////////////////////////////////////////////
 
-			int Post(int msgid, void * context, MQOWNER CallerOwns, MQCONTEXT isIntCtx);
+			int PostData(int msgid, const void * data, uint8_t size, MQCONTEXT isIntCtx, MQPRIORITY prio=MQ_PRIORITY_NORMAL);
 
 	};
 } // namespace Kernel
@@ -98,6 +98,24 @@ namespace Kernel {
 		return ((millis()-tmr)> time);
 	}
 
+	////////////////////////////////////////////////////////////////////////
+	/// Remaining
+	///
+	/// Time left before isExpired becomes true
+	///
+	/// @context: ANY
+	/// @scope: PUBLIC
+	/// @param: none
+	/// @return: milliseconds until expiry, zero if already expired
+	///
+	////////////////////////////////////////////////////////////////////////
+
+	unsigned long OSTimer::Remaining(void)
+	{
+		unsigned long elapsed=millis()-tmr;
+		return (elapsed>time)?0:(time-elapsed+1);
+	}
+
 	////////////////////////////////////////////////////////////////////////
 	/// Freeze
 	///
@@ -92,6 +92,21 @@ namespace Kernel {
 
 			int isExpired(void);
 
+			////////////////////////////////////////////////////////////////////////
+			/// Remaining
+			///
+			/// Time left before isExpired becomes true, e.g. to pass to
+			/// Task::WakeAfter
+			///
+			/// @context: ANY
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: milliseconds until expiry, zero if already expired
+			///
+			////////////////////////////////////////////////////////////////////////
+
+			unsigned long Remaining(void);
+
 			////////////////////////////////////////////////////////////////////////
 			/// Freeze
 			///
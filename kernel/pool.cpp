@@ -0,0 +1,29 @@
+///////////////////////////////////////////////////////////////////////////////
+/// pool.cpp
+///
+/// Fixed-block pool allocator for kernel objects
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "pool.h"
+
+namespace Kernel {
+
+	PoolBase * PoolBase::pFirst;
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// PoolBase
+	///
+	/// CONSTRUCTOR, PROTECTED
+	///
+	/// Name the pool and link it into the list of pools. The occupancy counters
+	/// are deliberately left alone: see pool.h.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	PoolBase::PoolBase(const char * name, uint8_t capacity) : name(name), capacity(capacity)
+	{
+		pNext=pFirst;
+		pFirst=this;
+	}
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+/// pool.h
+///
+/// Fixed-block pool allocator for kernel objects
+///
+/// Each pool holds a compile-time number of blocks of one type, so that
+/// allocation and release are O(1), deterministic, and can't fragment the
+/// heap. Kernel classes route their operator new/delete to a pool.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Kernel {
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// PoolBase
+	///
+	/// Occupancy statistics common to all pools. Every pool links itself into a
+	/// list when constructed so that the whole set can be walked to report
+	/// high-water marks, e.g.
+	///
+	///   for(const PoolBase * p=PoolBase::First();p;p=p->Next()) ...
+	///
+	/// Pools are static objects. Their counters are zero-initialized before any
+	/// constructor runs and the constructor does not touch them, so a pool may
+	/// safely be used by another static constructor that happens to run first.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	class PoolBase {
+
+		private:
+
+			static PoolBase *	pFirst;
+
+			const char *		name;
+			PoolBase *			pNext;
+
+		protected:
+
+			uint8_t				capacity;
+			uint8_t				used;
+			uint8_t				highWater;
+			uint8_t				failures;
+
+			PoolBase(const char * name, uint8_t capacity);
+
+			void Taken(void) { if(++used>highWater) highWater=used; };
+			void Released(void) { used--; };
+			void Failed(void) { if(failures<0xff) failures++; };
+
+		public:
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// First
+			///
+			/// Head of the list of all pools
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC, STATIC
+			/// @param: none
+			/// @return: first pool, or NULL
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			static const PoolBase * First(void) { return pFirst; };
+
+			const PoolBase *	Next(void) const { return pNext; };
+			const char *		Name(void) const { return name; };
+			uint8_t				Capacity(void) const { return capacity; };
+			uint8_t				Used(void) const { return used; };
+			uint8_t				HighWater(void) const { return highWater; };
+			uint8_t				Failures(void) const { return failures; };
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Pool
+	///
+	/// A pool of N blocks, each big enough for a T. Blocks are carved from the
+	/// static array in order on first use and recycled through a free list after
+	/// that.
+	///
+	/// Not interrupt safe: kernel objects are only created and destroyed at task
+	/// time.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	template <class T, uint8_t N> class Pool : public PoolBase {
+
+		private:
+
+			union BLOCK {
+				BLOCK *		pNext;
+				uint8_t		data[sizeof(T)] __attribute__((aligned(__alignof__(T))));
+			};
+
+			BLOCK		blocks[N];
+			BLOCK *		pFree;
+			uint8_t		carved;
+
+		public:
+
+			Pool(const char * name) : PoolBase(name,N) {};
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Alloc
+			///
+			/// Take a block from the pool
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: pointer to an uninitialized block, NULL if exhausted
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void * Alloc(void)
+			{
+				BLOCK * block=pFree;
+				if(block) {
+					pFree=block->pNext;
+				} else if(carved<N) {
+					block=&blocks[carved++];
+				} else {
+					Failed();
+					return NULL;
+				}
+				Taken();
+				return block;
+			}
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Free
+			///
+			/// Return a block to the pool
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: block - pointer previously returned by Alloc. NULL is ignored
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Free(void * ptr)
+			{
+				if(ptr) {
+					BLOCK * block=(BLOCK *)ptr;
+					block->pNext=pFree;
+					pFree=block;
+					Released();
+				}
+			}
+	};
+}
+
+#endif
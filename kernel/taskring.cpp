@@ -8,60 +8,161 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "taskring.h"
+#include "pool.h"
 #include <stdlib.h>
 
-#define TR_TASKTYPE_FCTN	0
-#define TR_TASKTYPE_CLASS	1
-
 //
 // task ring internals
 
 namespace Kernel {
 
-	// Task state structure
+	// A task function is wrapped in a task of its own so that the ring only
+	// ever holds Task classes
 
-	typedef class TASKSTATE * 	PTASKSTATE;
-	class TASKSTATE {
-		public:
-			void *				handler;
-			uint8_t				type;
-			union {
-				PFNTASKHANDLER		fHandler;
-			} pointers;
-			void *				context;
-			PTASKSTATE			pNext;
-			TASKSTATE() : pNext(NULL) {};
-			virtual ~TASKSTATE() {};
-			virtual void Call()=0;
-	};
-
-	typedef class TASKSTATE_C	PTASKSTATE_C;
-	class TASKSTATE_C : public TASKSTATE {
-		public:
-			Task *				Handler;
-			TASKSTATE_C(Task * handler) : Handler(handler) {};
-			void Call() { Handler->TaskLoop(); };
-	};
-
-	typedef class TASKSTATE_F	PTASKSTATE_F;
-	class TASKSTATE_F : public TASKSTATE {
+	typedef class TASKFUNCTION * PTASKFUNCTION;
+	class TASKFUNCTION : public Task {
 		public:
 			PFNTASKHANDLER	Handler;
 			void *			context;
-			TASKSTATE_F(PFNTASKHANDLER handler, void * context) : Handler(handler),context(context) {};
-			void Call() { Handler(context); };
+			TASKFUNCTION(PFNTASKHANDLER handler, void * context) : Handler(handler),context(context) {};
+			void TaskLoop(void) { Handler(context); };
+			void * operator new(size_t size) throw();
+			void operator delete(void * ptr);
 	};
 
+	// task function pool
+
+	static Pool<TASKFUNCTION,TASK_MAX_FUNCTIONS>	TaskFunctionPool("TASKFUNCTION");
+
+	void * TASKFUNCTION::operator new(size_t size) throw() { return TaskFunctionPool.Alloc(); }
+	void TASKFUNCTION::operator delete(void * ptr) { TaskFunctionPool.Free(ptr); }
+
+	// true if millis() time a is before b, allowing for wrap
+
+	#define TR_BEFORE(a,b)		((long)((a)-(b))<0)
+
 	// Task internal structure
+	//
+	// The running tasks form a doubly linked list through the links in each
+	// Task. pCur is the next task to run; NULL when a pass of the ring is
+	// complete. Suspended tasks are simply not on the list. Sleeping tasks are
+	// in a binary min-heap on their wake time; each knows its heap index so it
+	// can be taken out early.
 
 	typedef class TASKINTERNALS *	PTASKINTERNALS;
 	class TASKINTERNALS {
 		public:
-			PTASKSTATE	pHead;
-			PTASKSTATE	pCur;
-			TASKINTERNALS() : pHead(NULL),pCur(NULL) {};
+			Task *		pHead;
+			Task *		pTail;
+			Task *		pCur;
+			Task *		Heap[TASK_MAX_SLEEPING];
+			uint8_t		nSleeping;
+			constexpr TASKINTERNALS() : pHead(NULL),pTail(NULL),pCur(NULL),Heap(),nSleeping(0) {};
+
+			// put a task into a heap slot
+
+			void Place(Task * task, uint8_t idx)
+			{
+				Heap[idx]=task;
+				task->heapIndex=idx;
+			}
+
+			// restore the heap order from a slot towards the root, then the leaves
+
+			void SiftUp(uint8_t idx)
+			{
+				Task * task=Heap[idx];
+				while(idx) {
+					uint8_t parent=(idx-1)>>1;
+					if(!TR_BEFORE(task->wakeTime,Heap[parent]->wakeTime)) {
+						break;
+					}
+					Place(Heap[parent],idx);
+					idx=parent;
+				}
+				Place(task,idx);
+			}
+
+			void SiftDown(uint8_t idx)
+			{
+				Task * task=Heap[idx];
+				for(;;) {
+					uint8_t child=(idx<<1)+1;
+					if(child>=nSleeping) {
+						break;
+					}
+					if((child+1<nSleeping) && TR_BEFORE(Heap[child+1]->wakeTime,Heap[child]->wakeTime)) {
+						child++;
+					}
+					if(!TR_BEFORE(Heap[child]->wakeTime,task->wakeTime)) {
+						break;
+					}
+					Place(Heap[child],idx);
+					idx=child;
+				}
+				Place(task,idx);
+			}
+
+			// add a sleeping task to the heap, which must have room
+
+			void Push(Task * task)
+			{
+				Place(task,nSleeping++);
+				SiftUp(task->heapIndex);
+			}
+
+			// take a sleeping task out of the heap
+
+			void Remove(Task * task)
+			{
+				uint8_t idx=task->heapIndex;
+				Task * last=Heap[--nSleeping];
+				if(last!=task) {
+					Place(last,idx);
+					SiftUp(idx);
+					SiftDown(last->heapIndex);
+				}
+			}
+
+			// append a task that is not on the ring
+
+			void Link(Task * task)
+			{
+				task->pTaskNext=NULL;
+				task->pTaskPrev=pTail;
+				if(pTail) {
+					pTail->pTaskNext=task;
+				} else {
+					pHead=task;
+				}
+				pTail=task;
+			}
+
+			// remove a task from the ring. If it was due to run next, its
+			// successor runs instead.
+
+			void Unlink(Task * task)
+			{
+				if(pCur==task) {
+					pCur=task->pTaskNext;
+				}
+				if(task->pTaskPrev) {
+					task->pTaskPrev->pTaskNext=task->pTaskNext;
+				} else {
+					pHead=task->pTaskNext;
+				}
+				if(task->pTaskNext) {
+					task->pTaskNext->pTaskPrev=task->pTaskPrev;
+				} else {
+					pTail=task->pTaskPrev;
+				}
+				task->pTaskNext=NULL;
+				task->pTaskPrev=NULL;
+			}
 	};
 
+	static TASKINTERNALS TaskInternals;
+
 	///////////////////////////////////////////////////////////////////////////////
 	/// TASKRing
 	///
@@ -79,7 +180,7 @@ namespace Kernel {
 
 	TaskRing::TaskRing(void)
 	{
-		this->internals=new TASKINTERNALS;
+		this->internals=&TaskInternals;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -104,25 +205,83 @@ namespace Kernel {
 	/// Loop
 	///
 	/// Called by the kernel at task time to sequentially call the handlers.
+	/// Each call runs the next task in the ring.
 	///
 	/// @scope:	  EXPORTED
 	/// @context: TASK
 	/// @param:   none
+	/// @return:  true if there are more tasks to run before the ring wraps,
+	///           false once a full pass of the ring is complete
 	///
 	///////////////////////////////////////////////////////////////////////////////
 
-	void TaskRing::Loop(void)
+	bool TaskRing::Loop(void)
 	{
 		PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
 
+		// at the start of each pass of the ring, wake any sleepers that are due
+
 		if(internal->pCur==NULL) {
+			if(internal->nSleeping) {
+				unsigned long now=millis();
+				while(internal->nSleeping && !TR_BEFORE(now,internal->Heap[0]->wakeTime)) {
+					Task * task=internal->Heap[0];
+					internal->Remove(task);
+					internal->Link(task);
+					task->taskState=Task::TASK_STATE_RUNNING;
+				}
+			}
 			internal->pCur=internal->pHead;
 		}
 
-		if(internal->pCur) {
-			internal->pCur->Call();					// dispatch to the task handler
-			internal->pCur=internal->pCur->pNext;
+		// step past the task before calling it, so that it may deregister,
+		// suspend or delete itself
+
+		Task * task=internal->pCur;
+		if(task) {
+			internal->pCur=task->pTaskNext;
+			task->TaskLoop();						// dispatch to the task handler
 		}
+		return internal->pCur!=NULL;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Runnable
+	///
+	/// Called by the kernel to decide whether it may sleep the CPU
+	///
+	/// @scope:	  EXPORTED
+	/// @context: TASK
+	/// @param:   none
+	/// @return:  true if any task is on the ring
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	bool TaskRing::Runnable(void)
+	{
+		return ((PTASKINTERNALS)(this->internals))->pHead!=NULL;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// NextWake
+	///
+	/// Earliest wake time of the sleeping tasks: the root of the heap
+	///
+	/// @scope:	  EXPORTED
+	/// @context: TASK
+	/// @param:   ms - receives the millis() time of the earliest deadline
+	/// @return:  false if no task is sleeping
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	bool TaskRing::NextWake(unsigned long * ms)
+	{
+		PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
+		if(!internal->nSleeping) {
+			return false;
+		}
+		*ms=internal->Heap[0]->wakeTime;
+		return true;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -145,12 +304,9 @@ namespace Kernel {
 	{
 		int rc=-1;
 		if(handler) {
-			PTASKSTATE pNew = new TASKSTATE_F((void *)handler,context);
-			PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
+			PTASKFUNCTION pNew = new TASKFUNCTION(handler,context);
 			if(pNew) {
-				pNew->pNext=internal->pHead;
-				internal->pHead=pNew;
-				rc=0;
+				rc=RegisterTaskHandler(pNew);
 			}
 		}
 		return rc;
@@ -166,20 +322,17 @@ namespace Kernel {
 	/// @scope: EXPORTED
 	/// @context: TASK
 	/// @param:   Task * task
+	/// @return:  zero for success, -1 if already registered
 	///
 	///////////////////////////////////////////////////////////////////////////////
 
 	int TaskRing::RegisterTaskHandler(Task * task)
 	{
 		int rc=-1;
-		if(task) {
-			PTASKSTATE pNew = new TASKSTATE_C(task);
-			PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
-			if(pNew) {
-				pNew->pNext=internal->pHead;
-				internal->pHead=pNew;
-				rc=0;
-			}
+		if(task && task->taskState==Task::TASK_STATE_STOPPED) {
+			((PTASKINTERNALS)(this->internals))->Link(task);
+			task->taskState=Task::TASK_STATE_RUNNING;
+			rc=0;
 		}
 		return rc;
 	}
@@ -190,11 +343,119 @@ namespace Kernel {
 	/// Passed a pointer to a task class, will deregister this task from the task
 	/// manager. Essential if Task classes are dynamically destroyed.
 	///
+	/// @scope: EXPORTED
+	/// @context: TASK
+	/// @param:   Task * task
+	/// @return:  zero for success, -1 if the task was not registered
+	///
 	///////////////////////////////////////////////////////////////////////////////
 
 	int TaskRing::DeregisterTaskHandler(Task * task)
 	{
+		int rc=-1;
+		if(task && task->taskState!=Task::TASK_STATE_STOPPED) {
+			if(task->taskState==Task::TASK_STATE_RUNNING) {
+				((PTASKINTERNALS)(this->internals))->Unlink(task);
+			} else if(task->taskState==Task::TASK_STATE_SLEEPING) {
+				((PTASKINTERNALS)(this->internals))->Remove(task);
+			}
+			task->taskState=Task::TASK_STATE_STOPPED;
+			rc=0;
+		}
+		return rc;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Suspend
+	///
+	/// Take a running or sleeping task off the ring, leaving it registered
+	///
+	/// @scope: EXPORTED
+	/// @context: TASK
+	/// @param:   Task * task
+	/// @return:  zero for success, -1 if the task is neither running nor
+	///           sleeping
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int TaskRing::Suspend(Task * task)
+	{
+		PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
+		int rc=-1;
+		if(task) {
+			if(task->taskState==Task::TASK_STATE_RUNNING) {
+				internal->Unlink(task);
+				rc=0;
+			} else if(task->taskState==Task::TASK_STATE_SLEEPING) {
+				internal->Remove(task);
+				rc=0;
+			}
+			if(!rc) {
+				task->taskState=Task::TASK_STATE_SUSPENDED;
+			}
+		}
+		return rc;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Resume
+	///
+	/// Put a suspended or sleeping task back on the ring. It is appended, so
+	/// runs after the tasks already on it.
+	///
+	/// @scope: EXPORTED
+	/// @context: TASK
+	/// @param:   Task * task
+	/// @return:  zero for success, -1 if the task is neither suspended nor
+	///           sleeping
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	int TaskRing::Resume(Task * task)
+	{
+		PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
+		int rc=-1;
+		if(task) {
+			if(task->taskState==Task::TASK_STATE_SLEEPING) {
+				internal->Remove(task);
+				rc=0;
+			} else if(task->taskState==Task::TASK_STATE_SUSPENDED) {
+				rc=0;
+			}
+			if(!rc) {
+				internal->Link(task);
+				task->taskState=Task::TASK_STATE_RUNNING;
+			}
+		}
+		return rc;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Sleep
+	///
+	/// Move a running task from the ring to the deadline heap
+	///
+	/// @scope: EXPORTED
+	/// @context: TASK
+	/// @param:   Task * task
+	/// @param:   when - millis() time to wake at
+	/// @return:  zero for success, -1 if the task is not running or the heap
+	///           is full
+	///
+	///////////////////////////////////////////////////////////////////////////////
 
+	int TaskRing::Sleep(Task * task, unsigned long when)
+	{
+		PTASKINTERNALS internal=(PTASKINTERNALS)(this->internals);
+		int rc=-1;
+		if(task && task->taskState==Task::TASK_STATE_RUNNING && internal->nSleeping<TASK_MAX_SLEEPING) {
+			internal->Unlink(task);
+			task->wakeTime=when;
+			internal->Push(task);
+			task->taskState=Task::TASK_STATE_SLEEPING;
+			rc=0;
+		}
+		return rc;
 	}
 
 }
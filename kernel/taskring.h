@@ -15,6 +15,20 @@
 
 typedef void (*PFNTASKHANDLER)(void * context);
 
+// Task classes carry their own ring links. Task functions are wrapped in a
+// task taken from a fixed pool: the most task functions that can be
+// registered at once
+
+#ifndef TASK_MAX_FUNCTIONS
+#define TASK_MAX_FUNCTIONS			4
+#endif
+
+// Size of the deadline heap: the most tasks that can be sleeping at once
+
+#ifndef TASK_MAX_SLEEPING
+#define TASK_MAX_SLEEPING			8
+#endif
+
 // the Arduino 'loop' function is declared with 'C' linkage, not C++
 
 namespace Kernel {
@@ -50,14 +64,45 @@ namespace Kernel {
 			/// Loop
 			///
 			/// Called by the kernel at task time to sequentially call the handlers.
+			/// Each call runs the next task in the ring.
 			///
 			/// @scope:	  EXPORTED
 			/// @context: TASK
 			/// @param:   none
+			/// @return:  true if there are more tasks to run before the ring wraps,
+			///           false once a full pass of the ring is complete
 			///
 			///////////////////////////////////////////////////////////////////////////////
 
-			void Loop(void);
+			bool Loop(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Runnable
+			///
+			/// Called by the kernel to decide whether it may sleep the CPU
+			///
+			/// @scope:	  EXPORTED
+			/// @context: TASK
+			/// @param:   none
+			/// @return:  true if any task is on the ring
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			bool Runnable(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// NextWake
+			///
+			/// Earliest wake time of the sleeping tasks
+			///
+			/// @scope:	  EXPORTED
+			/// @context: TASK
+			/// @param:   ms - receives the millis() time of the earliest deadline
+			/// @return:  false if no task is sleeping
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			bool NextWake(unsigned long * ms);
 
 		public:
 
@@ -112,12 +157,70 @@ namespace Kernel {
 			/// DeregisterTaskHandler
 			///
 			/// Passed a pointer to a task class, will deregister this task from the task
-			/// manager. Essential if Task classes are dynamically destroyed.
+			/// manager. Essential if Task classes are dynamically destroyed. O(1)
+			/// (O(log n) if sleeping), and safe to call from the task's own TaskLoop.
+			///
+			/// @scope: EXPORTED
+			/// @context: TASK
+			/// @param:   Task * task
+			/// @return:  zero for success, -1 if the task was not registered
 			///
 			///////////////////////////////////////////////////////////////////////////////
 
 			int DeregisterTaskHandler(Task * task);
 
+			///////////////////////////////////////////////////////////////////////////////
+			/// Suspend
+			///
+			/// Take a registered task off the ring. It stays registered but is not
+			/// called, and costs nothing per pass, until resumed. O(1) for a running
+			/// task, O(log n) for a sleeping one, and safe to call from the task's
+			/// own TaskLoop.
+			///
+			/// @scope: EXPORTED
+			/// @context: TASK
+			/// @param:   Task * task
+			/// @return:  zero for success, -1 if the task is neither running nor
+			///           sleeping
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Suspend(Task * task);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Resume
+			///
+			/// Put a suspended task back on the ring, or wake a sleeping one early.
+			/// O(1) for a suspended task, O(log n) for a sleeping one.
+			///
+			/// @scope: EXPORTED
+			/// @context: TASK
+			/// @param:   Task * task
+			/// @return:  zero for success, -1 if the task is neither suspended nor
+			///           sleeping
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Resume(Task * task);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Sleep
+			///
+			/// Take a running task off the ring until the given time. Sleeping tasks
+			/// are kept in a min-heap on their wake time, so the earliest is always at
+			/// hand for the kernel's idle sleep. O(log n), and safe to call from the
+			/// task's own TaskLoop.
+			///
+			/// @scope: EXPORTED
+			/// @context: TASK
+			/// @param:   Task * task
+			/// @param:   when - millis() time to wake at
+			/// @return:  zero for success, -1 if the task is not running or
+			///           TASK_MAX_SLEEPING tasks are already sleeping
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			int Sleep(Task * task, unsigned long when);
 
 	};
 }
@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////////
+/// timers.cpp
+///
+/// Kernel timer service
+///
+/// The wheel follows the classic hierarchical scheme: a timer due within 16
+/// ticks goes straight into the bottom level slot for its tick, otherwise
+/// into the slot of the lowest level that spans it. Each time the bottom
+/// level wraps, the next slot of the level above is emptied and its timers
+/// refiled, and so on up. Every timer is therefore handled a bounded number
+/// of times however many others are running.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "timers.h"
+
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS-1)
+#define TIMER_SLOT_FIRING	0xff		// taken off the wheel, about to fire
+
+namespace Kernel {
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Timer
+	///
+	/// CONSTRUCTOR
+	///
+	/// A timer that calls a function on expiry
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	Timer::Timer(PFNTIMERCALLBACK callback, void * context) :
+		pNext(NULL), ppPrev(NULL), expires(0), period(0), callback(callback), context(context),
+		msgid(MSG_ID_NOMESSAGE), prio(MQ_PRIORITY_NORMAL), slot(TIMER_SLOT_FIRING)
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Timer
+	///
+	/// CONSTRUCTOR
+	///
+	/// A timer that posts a message on expiry
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	Timer::Timer(int msgid, void * context, MQPRIORITY prio) :
+		pNext(NULL), ppPrev(NULL), expires(0), period(0), callback(NULL), context(context),
+		msgid(msgid), prio(prio), slot(TIMER_SLOT_FIRING)
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// ~Timer
+	///
+	/// DESTRUCTOR
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	Timer::~Timer()
+	{
+		Stop();
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Start
+	///
+	/// Start, or restart, the timer. The tick the wheel is on has already been
+	/// processed, so the earliest a timer can fire is the next one.
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: ms - time to first expiry, in milliseconds
+	/// @param: period - interval between subsequent expiries, zero for one-shot
+	/// @return: none
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void Timer::Start(unsigned long ms, unsigned long period)
+	{
+		TimerService& svc=TimerService::Get();
+		unsigned long now=millis();
+
+		svc.Remove(this);
+		if(!svc.running) {
+			svc.current=now;				// nothing to catch up on
+		}
+		this->period=period;
+		expires=now+ms;
+		if((long)(expires-svc.current)<=0) {
+			expires=svc.current+1;
+		}
+		svc.Insert(this);
+		svc.running++;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Stop
+	///
+	/// Stop the timer if it is running
+	///
+	/// @scope: PUBLIC
+	/// @context: TASK
+	/// @param: none
+	/// @return: none
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void Timer::Stop(void)
+	{
+		TimerService::Get().Remove(this);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Fire
+	///
+	/// Expiry action: call the callback or post the message
+	///
+	/// @scope: PRIVATE
+	/// @context: TASK
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void Timer::Fire(void)
+	{
+		if(callback) {
+			callback(context);
+		} else {
+			MQClass::Get().Post(msgid,context,MQ_OWNER_CALLER,MQ_CONTEXT_TASK,(MQPRIORITY)prio);
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// TimerService
+	///
+	/// CONSTRUCTOR, PRIVATE
+	///
+	/// The wheel starts out empty
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	TimerService::TimerService(void) : Wheel(), Occupied(), current(0), running(0)
+	{
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Get
+	///
+	/// Obtain the singleton class instance
+	///
+	/// @scope: PUBLIC
+	/// @context: ANY
+	/// @param: none
+	/// @return: reference to singleton class
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	TimerService& TimerService::Get(void)
+	{
+		static TimerService ts;
+		return ts;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Insert
+	///
+	/// File a timer in the slot of the lowest level that spans its expiry.
+	/// The expiry must not be before the current tick; a timer due on the
+	/// current tick (only while cascading) goes in the bottom slot about to
+	/// be fired.
+	///
+	/// @scope: PRIVATE
+	/// @context: TASK
+	/// @param: timer - timer not on the wheel
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void TimerService::Insert(Timer * timer)
+	{
+		unsigned long delta=timer->expires-current;
+		unsigned long when=timer->expires;
+		uint8_t level=0;
+
+		while((level<TIMER_WHEEL_LEVELS-1) && (delta>>(TIMER_WHEEL_BITS*(level+1)))) {
+			level++;
+		}
+		if(delta>>(TIMER_WHEEL_BITS*TIMER_WHEEL_LEVELS)) {
+			// beyond the top level: park in its furthest slot and refile from there
+			when=current+(1UL<<(TIMER_WHEEL_BITS*TIMER_WHEEL_LEVELS))-1;
+		}
+		uint8_t idx=(when>>(TIMER_WHEEL_BITS*level)) & TIMER_WHEEL_MASK;
+
+		Timer ** ppHead=&Wheel[level][idx];
+		timer->pNext=*ppHead;
+		if(timer->pNext) {
+			timer->pNext->ppPrev=&timer->pNext;
+		}
+		*ppHead=timer;
+		timer->ppPrev=ppHead;
+		timer->slot=(level<<4)|idx;
+		Occupied[level]|=(1U<<idx);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Remove
+	///
+	/// Unlink a timer from wherever it is and count it as stopped. Does
+	/// nothing if the timer isn't running.
+	///
+	/// @scope: PRIVATE
+	/// @context: TASK
+	/// @param: timer
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void TimerService::Remove(Timer * timer)
+	{
+		if(!timer->ppPrev) {
+			return;
+		}
+		*timer->ppPrev=timer->pNext;
+		if(timer->pNext) {
+			timer->pNext->ppPrev=timer->ppPrev;
+		}
+		if(timer->slot!=TIMER_SLOT_FIRING) {
+			uint8_t level=timer->slot>>4;
+			uint8_t idx=timer->slot & TIMER_WHEEL_MASK;
+			if(!Wheel[level][idx]) {
+				Occupied[level]&=~(1U<<idx);
+			}
+		}
+		timer->pNext=NULL;
+		timer->ppPrev=NULL;
+		running--;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Cascade
+	///
+	/// Empty the slot of a level that the current tick has just reached and
+	/// refile its timers, which now fall into lower levels
+	///
+	/// @scope: PRIVATE
+	/// @context: TASK
+	/// @param: level - 1 or above
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	void TimerService::Cascade(uint8_t level)
+	{
+		uint8_t idx=(current>>(TIMER_WHEEL_BITS*level)) & TIMER_WHEEL_MASK;
+		Timer * timer=Wheel[level][idx];
+
+		Wheel[level][idx]=NULL;
+		Occupied[level]&=~(1U<<idx);
+		while(timer) {
+			Timer * next=timer->pNext;
+			Insert(timer);
+			timer=next;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// Loop
+	///
+	/// Bring the wheel up to millis() one tick at a time, cascading on each wrap
+	/// of the bottom level and firing the bottom slot of each tick. Runs of
+	/// empty bottom slots are skipped in one step.
+	///
+	/// The timers of a slot are moved to a private list before any fires, and
+	/// each is unlinked before its action runs, so that actions may stop or
+	/// restart any timer. A periodic timer is refiled before it fires.
+	///
+	/// @scope:	  EXPORTED
+	/// @context: TASK
+	/// @param:   none
+	/// @return:  number of timers fired
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	uint8_t TimerService::Loop(void)
+	{
+		unsigned long now=millis();
+		uint8_t fired=0;
+
+		while(current!=now) {
+			if(!running) {
+				current=now;
+				break;
+			}
+
+			// nothing in the bottom level: go straight to its last tick before the wrap
+
+			if(!Occupied[0]) {
+				unsigned long last=current|TIMER_WHEEL_MASK;
+				if((long)(now-last)<=0) {
+					current=now;
+					break;
+				}
+				current=last;
+			}
+			current++;
+
+			// refill from above on each wrap
+
+			for(uint8_t level=1;level<TIMER_WHEEL_LEVELS;level++) {
+				if((current>>(TIMER_WHEEL_BITS*(level-1))) & TIMER_WHEEL_MASK) {
+					break;
+				}
+				Cascade(level);
+			}
+
+			// fire the slot for this tick
+
+			uint8_t idx=current & TIMER_WHEEL_MASK;
+			if(Occupied[0] & (1U<<idx)) {
+				Timer * firing=Wheel[0][idx];
+				Wheel[0][idx]=NULL;
+				Occupied[0]&=~(1U<<idx);
+				firing->ppPrev=&firing;
+				for(Timer * timer=firing;timer;timer=timer->pNext) {
+					timer->slot=TIMER_SLOT_FIRING;
+				}
+				while(firing) {
+					Timer * timer=firing;
+					Remove(timer);
+					if(timer->period) {
+						timer->expires+=timer->period;
+						if((long)(timer->expires-current)<=0) {
+							timer->expires=current+1;
+						}
+						Insert(timer);
+						running++;
+					}
+					timer->Fire();
+					fired++;
+				}
+			}
+		}
+		return fired;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	/// NextExpiry
+	///
+	/// When the wheel next needs attention
+	///
+	/// @scope:	  EXPORTED
+	/// @context: TASK
+	/// @param:   ms - receives the millis() time
+	/// @return:  false if no timer is running
+	///
+	//////////////////////////////////////////////////////////////////////////////
+
+	bool TimerService::NextExpiry(unsigned long * ms)
+	{
+		if(!running) {
+			return false;
+		}
+		unsigned long next=(current|TIMER_WHEEL_MASK)+1;		// next wrap
+		if(Occupied[0]) {
+			for(uint8_t tick=1;tick<TIMER_WHEEL_SLOTS;tick++) {
+				if(Occupied[0] & (1U<<((current+tick) & TIMER_WHEEL_MASK))) {
+					if((long)(current+tick-next)<0) {
+						next=current+tick;
+					}
+					break;
+				}
+			}
+		}
+		*ms=next;
+		return true;
+	}
+}
@@ -0,0 +1,257 @@
+///////////////////////////////////////////////////////////////////////////////
+/// timers.h
+///
+/// Kernel timer service
+///
+/// Timers are kept on a hierarchical timing wheel ticking once a millisecond,
+/// so that starting and stopping a timer is O(1) and a loop pass only does
+/// work for the timers that are actually expiring. A timer either calls a
+/// function or posts a message when it expires, once or periodically.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TIMERS_H_
+#define _TIMERS_H_
+
+#include "sysincs.h"
+#include "mq.h"
+
+typedef void (*PFNTIMERCALLBACK)(void * context);
+
+// Wheel geometry. Each level has 16 slots, each slot of a level spanning the
+// whole of the level below: 1 ms, 16 ms, 256 ms and 4.096 s per slot. Timers
+// due further out than 65.5 s wait in the last slot of the top level and are
+// refiled when it comes round.
+
+#define TIMER_WHEEL_BITS			4
+#define TIMER_WHEEL_SLOTS			(1<<TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS			4
+
+namespace Kernel {
+
+	class TimerService;
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// Timer
+	///
+	/// A kernel timer. The caller owns the object, which is linked into the
+	/// wheel while running, so it must stay in scope until stopped; the
+	/// destructor stops it. Expiry is handled at task time by the kernel loop,
+	/// so callbacks run in task context and may start or stop any timer,
+	/// including their own.
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	class Timer {
+
+		private:
+
+			friend class TimerService;
+
+			// wheel slot links. ppPrev points at whatever points at us, so a
+			// timer can be unlinked without knowing its slot; NULL when stopped
+
+			Timer *				pNext;
+			Timer **			ppPrev;
+
+			unsigned long		expires;		// wheel tick to fire on
+			unsigned long		period;			// zero for a one-shot timer
+
+			PFNTIMERCALLBACK	callback;		// NULL to post msgid instead
+			void *				context;
+			int					msgid;
+			uint8_t				prio;			// MQPRIORITY of the message
+			uint8_t				slot;			// level<<4 | slot index
+
+			void Fire(void);
+
+		public:
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Timer
+			///
+			/// CONSTRUCTOR
+			///
+			/// A timer that calls a function on expiry
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: callback - function to call
+			/// @param: context - passed to the function
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			Timer(PFNTIMERCALLBACK callback, void * context=NULL);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Timer
+			///
+			/// CONSTRUCTOR
+			///
+			/// A timer that posts a message on expiry. The context is posted as owned
+			/// by the caller.
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: msgid - message to post
+			/// @param: context - message context
+			/// @param: prio - message priority
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			Timer(int msgid, void * context=NULL, MQPRIORITY prio=MQ_PRIORITY_NORMAL);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// ~Timer
+			///
+			/// DESTRUCTOR
+			///
+			/// Stops the timer, so a running timer can't be left linked into the wheel
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			~Timer();
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Start
+			///
+			/// Start, or restart, the timer. O(1).
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: ms - time to first expiry, in milliseconds
+			/// @param: period - interval between subsequent expiries, zero for a
+			///         one-shot timer. Periodic expiries are scheduled from the
+			///         previous expiry time, so they do not drift.
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Start(unsigned long ms, unsigned long period=0);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Stop
+			///
+			/// Stop the timer if it is running. O(1).
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: none
+			/// @return: none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			void Stop(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// isRunning
+			///
+			/// @scope: PUBLIC
+			/// @context: TASK
+			/// @param: none
+			/// @return: true if the timer is started and has not yet expired (for a
+			///          periodic timer, until stopped)
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			bool isRunning(void) const { return ppPrev!=NULL; };
+	};
+
+	///////////////////////////////////////////////////////////////////////////////
+	/// TimerService
+	///
+	/// The timing wheel. A singleton within the kernel, driven by loop().
+	///
+	///////////////////////////////////////////////////////////////////////////////
+
+	class TimerService {
+
+		private:
+
+			friend void ::loop();		// the kernel drives the wheel
+			friend class Timer;
+
+			Timer *			Wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+			uint16_t		Occupied[TIMER_WHEEL_LEVELS];	// bit per non-empty slot
+			unsigned long	current;						// last tick processed
+			uint8_t			running;						// timers on the wheel
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// TimerService
+			///
+			/// CONSTRUCTOR, PRIVATE
+			///
+			/// @scope: 	EXPORTED
+			/// @context: 	TASK
+			/// @param:  	none
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			TimerService(void);
+
+			void Insert(Timer * timer);
+			void Remove(Timer * timer);
+			void Cascade(uint8_t level);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Loop
+			///
+			/// Called by the kernel at task time to bring the wheel up to millis(),
+			/// firing the timers that fall due on the way.
+			///
+			/// @scope:	  EXPORTED
+			/// @context: TASK
+			/// @param:   none
+			/// @return:  number of timers fired
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			uint8_t Loop(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// NextExpiry
+			///
+			/// When the wheel next needs attention, for the kernel's idle sleep: the
+			/// exact expiry if a timer is due within the bottom level, otherwise the
+			/// next time the bottom level wraps and refills from the one above.
+			///
+			/// @scope:	  EXPORTED
+			/// @context: TASK
+			/// @param:   ms - receives the millis() time
+			/// @return:  false if no timer is running
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			bool NextExpiry(unsigned long * ms);
+
+		public:
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Get
+			///
+			/// Return the singleton class
+			///
+			/// @context: ANY
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: reference to single instance of static class
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			static TimerService& Get(void);
+
+			///////////////////////////////////////////////////////////////////////////////
+			/// Running
+			///
+			/// @context: TASK
+			/// @scope: PUBLIC
+			/// @param: none
+			/// @return: number of timers currently running
+			///
+			///////////////////////////////////////////////////////////////////////////////
+
+			uint8_t Running(void) const { return running; };
+	};
+}
+
+#endif